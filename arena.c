@@ -0,0 +1,159 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "arena.h"
+
+/*!
+    \file arena.c
+    \brief Implementation of arena_t
+*/
+
+#include "memory.h"
+
+#include <string.h>
+
+/*!
+    \internal
+    \brief Memory block from which arena allocations are carved
+*/
+typedef struct _arena_chunk {
+    struct _arena_chunk *next;
+    size_t size;
+    size_t used;
+} arena_chunk_t;
+
+struct _arena {
+    arena_chunk_t *head;
+    size_t chunk_size;
+    void *last;
+};
+
+enum {
+    ARENA_ALIGN = 2 * sizeof(void*),
+    ARENA_MIN_CHUNK = 4096,
+    ARENA_MAX_CHUNK = 1 << 20
+};
+
+#define ARENA_ROUND(sz) (((sz) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_CHUNK_DATA(c) ((char*)(c) + ARENA_ROUND(sizeof(arena_chunk_t)))
+
+/*!
+    \internal
+    \brief Add a new chunk able to hold at least \a sz bytes to an arena_t
+    Chunk sizes grow geometrically so that the number of chunks stays
+    logarithmic in the total amount of memory requested.
+*/
+static arena_chunk_t* arena_add_chunk(arena_t *arena, size_t sz) {
+    size_t size = arena->chunk_size;
+    if (arena->chunk_size < ARENA_MAX_CHUNK)
+        arena->chunk_size *= 2;
+    if (size < sz)
+        size = sz;
+    arena_chunk_t *chunk = (arena_chunk_t*)yas_malloc(ARENA_ROUND(sizeof(arena_chunk_t)) + size);
+    chunk->size = size;
+    chunk->used = 0;
+    if (arena->head && sz > arena->head->size - arena->head->used && size == sz) {
+        /* oversized request : keep the current chunk open for small ones */
+        chunk->next = arena->head->next;
+        arena->head->next = chunk;
+    } else {
+        chunk->next = arena->head;
+        arena->head = chunk;
+    }
+    return chunk;
+}
+
+/*!
+    \brief Create a new arena_t
+*/
+arena_t* arena_new() {
+    arena_t *arena = (arena_t*)yas_malloc(sizeof(arena_t));
+    arena->head = 0;
+    arena->chunk_size = ARENA_MIN_CHUNK;
+    arena->last = 0;
+    return arena;
+}
+
+/*!
+    \brief Destroy an arena_t and release all memory allocated from it
+*/
+void arena_destroy(arena_t *arena) {
+    if (!arena)
+        return;
+    arena_chunk_t *chunk = arena->head;
+    while (chunk) {
+        arena_chunk_t *next = chunk->next;
+        yas_free(chunk);
+        chunk = next;
+    }
+    yas_free(arena);
+}
+
+/*!
+    \brief Allocate memory from an arena_t
+    \param arena Arena to allocate from
+    \param sz Number of bytes to allocate
+    \return a pointer to \a sz bytes of uninitialized memory
+*/
+void* arena_alloc(arena_t *arena, size_t sz) {
+    sz = ARENA_ROUND(sz ? sz : 1);
+    arena_chunk_t *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < sz)
+        chunk = arena_add_chunk(arena, sz);
+    void *d = ARENA_CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += sz;
+    if (chunk == arena->head)
+        arena->last = d;
+    return d;
+}
+
+/*!
+    \brief Resize memory allocated from an arena_t
+    \param arena Arena \a d was allocated from
+    \param d Memory to resize, may be null
+    \param old_sz Current size of \a d
+    \param sz New size
+    \return a pointer to the resized memory
+    The last allocation of an arena is extended in place whenever possible.
+    Callers should grow geometrically to keep the amount of wasted memory
+    bounded when that is not possible.
+*/
+void* arena_realloc(arena_t *arena, void *d, size_t old_sz, size_t sz) {
+    if (!d)
+        return arena_alloc(arena, sz);
+    arena_chunk_t *chunk = arena->head;
+    if (d == arena->last) {
+        size_t offset = (char*)d - ARENA_CHUNK_DATA(chunk);
+        if (chunk->size - offset >= ARENA_ROUND(sz)) {
+            chunk->used = offset + ARENA_ROUND(sz);
+            return d;
+        }
+    }
+    void *n = arena_alloc(arena, sz);
+    memcpy(n, d, old_sz < sz ? old_sz : sz);
+    return n;
+}
+
+/*!
+    \brief Copy a string into an arena_t
+    \param arena Arena to allocate from
+    \param str String to copy
+    \param n Size of string to copy
+    \return a zero-terminated copy of the \a n first characters of \a str
+*/
+char* arena_strndup(arena_t *arena, const char *str, size_t n) {
+    char *s = (char*)arena_alloc(arena, (n + 1) * sizeof(char));
+    memcpy(s, str, n);
+    s[n] = 0;
+    return s;
+}
@@ -0,0 +1,40 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+/*!
+    \file arena.h
+    \brief Definition of arena_t
+*/
+
+#include <stddef.h>
+
+/*!
+    \brief A bump allocator
+    Memory obtained from an arena_t cannot be freed individually : it is
+    released all at once when the arena is destroyed. This makes building
+    short-lived trees (e.g. parsed command lines) cheap in both time and number
+    of calls to the system allocator.
+*/
+typedef struct _arena arena_t;
+
+arena_t* arena_new();
+void arena_destroy(arena_t *arena);
+
+void* arena_alloc(arena_t *arena, size_t sz);
+void* arena_realloc(arena_t *arena, void *d, size_t old_sz, size_t sz);
+char* arena_strndup(arena_t *arena, const char *str, size_t n);
+
+#endif /* _ARENA_H_ */
@@ -58,6 +58,9 @@ argv_t* argv_new() {
 void argv_destroy(argv_t *argv) {
     if (!argv)
         return;
+    size_t i;
+    for (i = 0; i < argv->n; ++i)
+        yas_free(argv->d[i]);
     yas_free(argv->d);
     yas_free(argv);
 }
@@ -89,6 +92,25 @@ int argv_add(argv_t *argv, const char *s) {
     return 0;
 }
 
+/*!
+    \internal
+    \return whether a word needs glob expansion
+    A '[' without a matching ']' is an ordinary character, e.g. for the [
+    builtin.
+*/
+int argv_is_pattern(const char *s, size_t n) {
+    size_t i;
+    if (n && *s == '~')
+        return 1;
+    for (i = 0; i < n; ++i) {
+        if (s[i] == '*' || s[i] == '?')
+            return 1;
+        else if (s[i] == '[' && memchr(s + i + 1, ']', n - i - 1))
+            return 1;
+    }
+    return 0;
+}
+
 /*!
     \brief Glob-expand and field-split a string and add the resulting string arguments to an argv_t
 */
@@ -103,6 +125,12 @@ int argv_add_split(argv_t *argv, const char *s) {
                 char *tmp = (char*)yas_malloc((current - last + 1) * sizeof(char));
                 strncpy(tmp, last, current - last);
                 tmp[current - last] = 0;
+                if (!argv_is_pattern(tmp, current - last)) {
+                    argv_add(argv, tmp);
+                    yas_free(tmp);
+                    last = current + 1;
+                    continue;
+                }
                 
                 glob_t globs;
                 int err = glob(tmp,
@@ -111,6 +139,7 @@ int argv_add_split(argv_t *argv, const char *s) {
                 if (err) {
                     fprintf(stderr, "Wildcard/tilde expansion failed.\n");
                     fprintf(stderr, "%s\n", tmp);
+                    yas_free(tmp);
                     return 1;
                 }
                 size_t j;
@@ -0,0 +1,466 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "arith.h"
+
+/*!
+    \file arith.c
+    \brief Implementation of the arithmetic expression evaluator
+
+    Expressions of $((...)) are evaluated in the shell process with 64-bit
+    signed integers, following the operators and precedence of C : comma,
+    assignments (= *= /= %= += -= <<= >>= &= ^= |=), ?:, ||, &&, |, ^, &,
+    == !=, < <= > >=, << >>, + -, * / %, unary + - ! ~ and prefix and postfix
+    ++ --. Numbers are decimal, octal (leading 0) or hexadecimal (0x).
+    Variables are referenced by name, with or without a leading $; unset or
+    empty variables are 0. Overflow wraps around instead of being undefined.
+
+    The evaluator is a recursive descent parser that computes values as it
+    goes. Operands that are not evaluated (e.g. the right side of && when
+    the left side is 0) are still parsed, but neither read nor assign
+    variables, which also provides a thread-safe syntax check.
+*/
+
+#include "var.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+    \internal
+    \brief Evaluator state
+*/
+typedef struct {
+    const char *p;
+    /* whether the current operand is evaluated, 0 during syntax checks */
+    int eval;
+    const char *error;
+} arith_t;
+
+enum arith_op {
+    ARITH_MUL,
+    ARITH_DIV,
+    ARITH_MOD,
+    ARITH_ADD,
+    ARITH_SUB,
+    ARITH_SHL,
+    ARITH_SHR,
+    ARITH_LT,
+    ARITH_LE,
+    ARITH_GT,
+    ARITH_GE,
+    ARITH_EQ,
+    ARITH_NE,
+    ARITH_BAND,
+    ARITH_XOR,
+    ARITH_BOR,
+    ARITH_AND,
+    ARITH_OR
+};
+
+/*!
+    \internal
+    \brief Binary or assignment operator
+*/
+typedef struct {
+    const char *text;
+    int precedence;
+    int op;
+} arith_operator_t;
+
+/* longest operators first, so that e.g. "<<" is not read as "<" */
+static const arith_operator_t _arith_binary[] = {
+    { "||", 1,  ARITH_OR   },
+    { "&&", 2,  ARITH_AND  },
+    { "==", 6,  ARITH_EQ   },
+    { "!=", 6,  ARITH_NE   },
+    { "<<", 8,  ARITH_SHL  },
+    { ">>", 8,  ARITH_SHR  },
+    { "<=", 7,  ARITH_LE   },
+    { ">=", 7,  ARITH_GE   },
+    { "|",  3,  ARITH_BOR  },
+    { "^",  4,  ARITH_XOR  },
+    { "&",  5,  ARITH_BAND },
+    { "<",  7,  ARITH_LT   },
+    { ">",  7,  ARITH_GT   },
+    { "+",  9,  ARITH_ADD  },
+    { "-",  9,  ARITH_SUB  },
+    { "*",  10, ARITH_MUL  },
+    { "/",  10, ARITH_DIV  },
+    { "%",  10, ARITH_MOD  }
+};
+
+static const arith_operator_t _arith_assign[] = {
+    { "<<=", 0, ARITH_SHL  },
+    { ">>=", 0, ARITH_SHR  },
+    { "*=",  0, ARITH_MUL  },
+    { "/=",  0, ARITH_DIV  },
+    { "%=",  0, ARITH_MOD  },
+    { "+=",  0, ARITH_ADD  },
+    { "-=",  0, ARITH_SUB  },
+    { "&=",  0, ARITH_BAND },
+    { "^=",  0, ARITH_XOR  },
+    { "|=",  0, ARITH_BOR  }
+};
+
+static long long arith_comma(arith_t *a);
+static long long arith_assign(arith_t *a);
+static long long arith_unary(arith_t *a);
+
+static void arith_skip_ws(arith_t *a) {
+    while (isspace((unsigned char)*a->p))
+        ++a->p;
+}
+
+/*!
+    \internal
+    \brief Consume \a text if it comes next
+*/
+static int arith_accept(arith_t *a, const char *text) {
+    arith_skip_ws(a);
+    size_t n = strlen(text);
+    if (strncmp(a->p, text, n))
+        return 0;
+    a->p += n;
+    return 1;
+}
+
+/*!
+    \internal
+    \brief Find the operator of a table that comes next, without consuming it
+*/
+static const arith_operator_t* arith_match(arith_t *a, const arith_operator_t *table, size_t n) {
+    size_t i;
+    arith_skip_ws(a);
+    for (i = 0; i < n; ++i)
+        if (!strncmp(a->p, table[i].text, strlen(table[i].text)))
+            return table + i;
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Copy a variable name into a null-terminated buffer
+*/
+static int arith_name(arith_t *a, const char *name, size_t n, char *buffer, size_t size) {
+    if (n >= size) {
+        a->error = "variable name too long";
+        return -1;
+    }
+    memcpy(buffer, name, n);
+    buffer[n] = 0;
+    return 0;
+}
+
+/*!
+    \internal
+    \return the value of a variable
+*/
+static long long arith_lookup(arith_t *a, const char *name, size_t n) {
+    char buffer[256];
+    if (!a->eval || arith_name(a, name, n, buffer, sizeof(buffer)))
+        return 0;
+    const char *value = var_get(buffer);
+    while (value && isspace((unsigned char)*value))
+        ++value;
+    if (!value || !*value)
+        return 0;
+    char *end;
+    long long v = (long long)strtoull(value, &end, 0);
+    while (isspace((unsigned char)*end))
+        ++end;
+    if (*end || !isdigit((unsigned char)value[*value == '-' || *value == '+']))
+        a->error = "variable is not a number";
+    return v;
+}
+
+/*!
+    \internal
+    \brief Assign a variable
+*/
+static void arith_store(arith_t *a, const char *name, size_t n, long long v) {
+    char buffer[256], value[32];
+    if (!a->eval || a->error || arith_name(a, name, n, buffer, sizeof(buffer)))
+        return;
+    if (var_flags(buffer) & VAR_READONLY) {
+        a->error = "readonly variable";
+        return;
+    }
+    snprintf(value, sizeof(value), "%lld", v);
+    var_set(buffer, value, 0);
+}
+
+/*!
+    \internal
+    \brief Apply a binary operator
+    Overflowing operations are computed on unsigned integers, which wrap
+    around.
+*/
+static long long arith_apply(arith_t *a, int op, long long x, long long y) {
+    unsigned long long ux = x, uy = y;
+    switch (op) {
+        case ARITH_MUL:
+            return (long long)(ux * uy);
+        case ARITH_DIV:
+        case ARITH_MOD:
+            if (!y) {
+                if (a->eval)
+                    a->error = "division by zero";
+                return 0;
+            }
+            if (y == -1)
+                return op == ARITH_DIV ? (long long)(0 - ux) : 0;
+            return op == ARITH_DIV ? x / y : x % y;
+        case ARITH_ADD:
+            return (long long)(ux + uy);
+        case ARITH_SUB:
+            return (long long)(ux - uy);
+        case ARITH_SHL:
+            return (long long)(ux << (y & 63));
+        case ARITH_SHR:
+            return x >> (y & 63);
+        case ARITH_LT:
+            return x < y;
+        case ARITH_LE:
+            return x <= y;
+        case ARITH_GT:
+            return x > y;
+        case ARITH_GE:
+            return x >= y;
+        case ARITH_EQ:
+            return x == y;
+        case ARITH_NE:
+            return x != y;
+        case ARITH_BAND:
+            return x & y;
+        case ARITH_XOR:
+            return x ^ y;
+        case ARITH_BOR:
+            return x | y;
+        case ARITH_AND:
+            return x && y;
+        case ARITH_OR:
+            return x || y;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Parse a number, a variable reference or a parenthesized expression
+*/
+static long long arith_primary(arith_t *a) {
+    arith_skip_ws(a);
+    if (arith_accept(a, "(")) {
+        long long v = arith_comma(a);
+        if (!a->error && !arith_accept(a, ")"))
+            a->error = "missing )";
+        return v;
+    }
+    if (isdigit((unsigned char)*a->p)) {
+        const char *end = a->p;
+        while (isalnum((unsigned char)*end))
+            ++end;
+        char *parsed;
+        long long v = (long long)strtoull(a->p, &parsed, 0);
+        if (parsed != end)
+            a->error = "invalid number";
+        a->p = end;
+        return v;
+    }
+    int dollar = *a->p == '$';
+    const char *name = a->p + dollar;
+    size_t n = var_name_length(name);
+    if (!n) {
+        a->error = *a->p ? "syntax error" : "operand expected";
+        return 0;
+    }
+    a->p = name + n;
+    long long v = arith_lookup(a, name, n);
+    if (!dollar) {
+        arith_skip_ws(a);
+        if ((a->p[0] == '+' || a->p[0] == '-') && a->p[1] == a->p[0]) {
+            /* postfix increment or decrement */
+            unsigned long long uv = v;
+            arith_store(a, name, n, (long long)(a->p[0] == '+' ? uv + 1 : uv - 1));
+            a->p += 2;
+        }
+    }
+    return v;
+}
+
+/*!
+    \internal
+    \brief Parse a unary expression
+*/
+static long long arith_unary(arith_t *a) {
+    arith_skip_ws(a);
+    char c = *a->p;
+    if ((c == '+' || c == '-') && a->p[1] == c) {
+        /* prefix increment or decrement, unless there is no variable */
+        const char *name = a->p + 2;
+        while (isspace((unsigned char)*name))
+            ++name;
+        size_t n = var_name_length(name);
+        if (n) {
+            a->p = name + n;
+            unsigned long long v = arith_lookup(a, name, n);
+            v = c == '+' ? v + 1 : v - 1;
+            arith_store(a, name, n, (long long)v);
+            return (long long)v;
+        }
+    }
+    if (c == '+' || c == '-' || c == '!' || c == '~') {
+        ++a->p;
+        long long v = arith_unary(a);
+        if (c == '-')
+            return (long long)(0 - (unsigned long long)v);
+        if (c == '!')
+            return !v;
+        if (c == '~')
+            return ~v;
+        return v;
+    }
+    return arith_primary(a);
+}
+
+/*!
+    \internal
+    \brief Parse binary operators of precedence \a min and above
+    The right side of && and || is only evaluated when needed.
+*/
+static long long arith_binary(arith_t *a, int min) {
+    long long x = arith_unary(a);
+    while (!a->error) {
+        const arith_operator_t *o = arith_match(a, _arith_binary,
+                                                sizeof(_arith_binary) / sizeof(_arith_binary[0]));
+        if (!o || o->precedence < min)
+            break;
+        a->p += strlen(o->text);
+        int eval = a->eval;
+        if (o->op == ARITH_AND)
+            a->eval = eval && x;
+        else if (o->op == ARITH_OR)
+            a->eval = eval && !x;
+        long long y = arith_binary(a, o->precedence + 1);
+        a->eval = eval;
+        x = arith_apply(a, o->op, x, y);
+    }
+    return x;
+}
+
+/*!
+    \internal
+    \brief Parse a conditional expression, only evaluating the chosen branch
+*/
+static long long arith_conditional(arith_t *a) {
+    long long c = arith_binary(a, 1);
+    if (a->error || !arith_accept(a, "?"))
+        return c;
+    int eval = a->eval;
+    a->eval = eval && c;
+    long long x = arith_comma(a);
+    if (!a->error && !arith_accept(a, ":"))
+        a->error = "missing :";
+    a->eval = eval && !c;
+    long long y = a->error ? 0 : arith_assign(a);
+    a->eval = eval;
+    return c ? x : y;
+}
+
+/*!
+    \internal
+    \brief Parse an assignment or a conditional expression
+*/
+static long long arith_assign(arith_t *a) {
+    arith_skip_ws(a);
+    const char *name = a->p;
+    size_t n = var_name_length(name);
+    if (n) {
+        a->p += n;
+        arith_skip_ws(a);
+        const arith_operator_t *o = 0;
+        int plain = a->p[0] == '=' && a->p[1] != '=';
+        if (!plain)
+            o = arith_match(a, _arith_assign, sizeof(_arith_assign) / sizeof(_arith_assign[0]));
+        if (plain || o) {
+            a->p += o ? strlen(o->text) : 1;
+            long long y = arith_assign(a);
+            if (a->error)
+                return 0;
+            long long v = o ? arith_apply(a, o->op, arith_lookup(a, name, n), y) : y;
+            arith_store(a, name, n, v);
+            return v;
+        }
+        a->p = name;
+    }
+    return arith_conditional(a);
+}
+
+/*!
+    \internal
+    \brief Parse a comma-separated list of expressions, whose value is the last one
+*/
+static long long arith_comma(arith_t *a) {
+    long long v = arith_assign(a);
+    while (!a->error && arith_accept(a, ","))
+        v = arith_assign(a);
+    return v;
+}
+
+static int arith_run(const char *expr, long long *result, const char **error, int eval) {
+    arith_t a;
+    a.p = expr;
+    a.eval = eval;
+    a.error = 0;
+    long long v = 0;
+    arith_skip_ws(&a);
+    /* an empty expression is 0 */
+    if (*a.p)
+        v = arith_comma(&a);
+    arith_skip_ws(&a);
+    if (!a.error && *a.p)
+        a.error = *a.p == ')' ? "unmatched )" : "syntax error";
+    if (result)
+        *result = a.error ? 0 : v;
+    if (error)
+        *error = a.error;
+    return a.error ? -1 : 0;
+}
+
+/*!
+    \brief Evaluate an arithmetic expression
+    \param expr Expression, without the enclosing $(( ))
+    \param result set to the value of the expression
+    \param error set to a description of the error, if any
+    \return 0 on success, -1 on error
+    Variables are read and assigned as the expression is evaluated : an
+    error may leave some assignments done.
+*/
+int arith_eval(const char *expr, long long *result, const char **error) {
+    return arith_run(expr, result, error, 1);
+}
+
+/*!
+    \brief Check the syntax of an arithmetic expression without evaluating it
+    \return 0 if the expression is valid, -1 otherwise
+    No global state is involved : arith_check may be called concurrently
+    from several threads.
+*/
+int arith_check(const char *expr, const char **error) {
+    return arith_run(expr, 0, error, 0);
+}
@@ -0,0 +1,25 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _ARITH_H_
+#define _ARITH_H_
+
+/*!
+    \file arith.h
+    \brief Definition of the arithmetic expression evaluator
+*/
+
+int arith_eval(const char *expr, long long *result, const char **error);
+int arith_check(const char *expr, const char **error);
+
+#endif /* _ARITH_H_ */
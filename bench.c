@@ -0,0 +1,632 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+/*!
+    \file bench.c
+    \brief YAS benchmark driver
+    
+    usage: yas_bench [-n lines] [-s MB] [name-prefix...]
+    
+    Results are printed as tab-separated values, one benchmark per line :
+    name, number of operations, ns/op, ops/s and allocations/op.
+    Allocations are counted by wrapping malloc, realloc and calloc at link
+    time (see the bench target of the Makefile).
+*/
+
+#include "memory.h"
+#include "dstring.h"
+#include "input.h"
+#include "command.h"
+#include "program.h"
+#include "argv.h"
+#include "exec.h"
+#include "options.h"
+#include "path.h"
+#include "var.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static unsigned long long _bench_allocs = 0;
+
+void* __real_malloc(size_t sz);
+void* __real_realloc(void *d, size_t sz);
+void* __real_calloc(size_t n, size_t sz);
+
+void* __wrap_malloc(size_t sz) {
+    ++_bench_allocs;
+    return __real_malloc(sz);
+}
+
+void* __wrap_realloc(void *d, size_t sz) {
+    ++_bench_allocs;
+    return __real_realloc(d, sz);
+}
+
+void* __wrap_calloc(size_t n, size_t sz) {
+    ++_bench_allocs;
+    return __real_calloc(n, sz);
+}
+
+/*!
+    \internal
+    \return a monotonic timestamp in nanoseconds
+*/
+static long long bench_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void bench_report(const char *name, long long ops, long long ns, unsigned long long allocs) {
+    fprintf(stdout, "%s\t%lli\t%.1f\t%.0f\t%.2f\n",
+            name,
+            ops,
+            ops ? (double)ns / ops : 0.0,
+            ns ? (double)ops * 1e9 / ns : 0.0,
+            ops ? (double)allocs / ops : 0.0);
+    fflush(stdout);
+}
+
+static int _bench_argc = 0;
+static char **_bench_argv = 0;
+
+/*!
+    \internal
+    \return whether a benchmark was selected on the command line
+*/
+static int bench_selected(const char *name) {
+    int i;
+    if (!_bench_argc)
+        return 1;
+    for (i = 0; i < _bench_argc; ++i)
+        if (!strncmp(name, _bench_argv[i], strlen(_bench_argv[i])))
+            return 1;
+    return 0;
+}
+
+/*!
+    \internal
+    \brief A benchmark body : performs \a n operations on \a data
+*/
+typedef void (*bench_fn_t)(void *data, long long n);
+
+/*!
+    \internal
+    \brief Time a benchmark body
+    The number of operations is doubled until a run lasts at least 200ms.
+*/
+static void bench_run(const char *name, bench_fn_t fn, void *data) {
+    if (!bench_selected(name))
+        return;
+    long long n = 1, ns = 0;
+    unsigned long long allocs = 0;
+    fn(data, 1);
+    while (1) {
+        unsigned long long a = _bench_allocs;
+        long long t = bench_now();
+        fn(data, n);
+        ns = bench_now() - t;
+        allocs = _bench_allocs - a;
+        if (ns >= 200000000LL || n >= (1LL << 40))
+            break;
+        n *= 2;
+    }
+    bench_report(name, n, ns, allocs);
+}
+
+/******************************************************************************/
+
+static const char *_bench_corpus[] = {
+    "ls -la /usr/local/bin",
+    "grep -rn \"TODO\" src/ | sort | uniq -c | sort -rn | head -20",
+    "find . -name \"*.c\" -newer Makefile",
+    "tar czf backup-$(date +%Y%m%d).tar.gz $HOME/projects",
+    "echo \"Build finished for $USER on $HOSTNAME\" > build.log",
+    "gcc -O2 -Wall -Wextra -o yas memory.o arena.o dstring.o input.o command.o",
+    "cat /proc/cpuinfo | grep processor | wc -l",
+    "ssh build@ci.example.org \"cd /srv/ci && ./run.sh\" < jobs.txt",
+    "make -j8 CFLAGS=\"-O3 -march=native\" all > /dev/null &",
+    "sed -e s/foo/bar/g input.txt > output.txt",
+    "git log --oneline --graph --decorate | less",
+    "curl -s https://example.org/api/v1/items?page=2 | jq .items",
+    "docker run --rm -v $PWD:/src -w /src gcc:12 make",
+    "xargs -n 1 -P 4 gzip < files.txt",
+    "rsync -avz --delete `hostname`:/var/www/ /srv/mirror/www/",
+    "echo prefix\"$HOME/with space\"suffix$(basename $PWD).log"
+};
+
+#define BENCH_CORPUS_SIZE (sizeof(_bench_corpus) / sizeof(_bench_corpus[0]))
+
+static void bench_parse_corpus(void *data, long long n) {
+    (void)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        const char *line = _bench_corpus[i % BENCH_CORPUS_SIZE];
+        command_t *command = command_create(line, strlen(line), 0);
+        if (!command) {
+            fprintf(stderr, "parse error : %s\n", line);
+            exit(1);
+        }
+        command_destroy(command);
+    }
+}
+
+static void bench_parse_string(void *data, long long n) {
+    string_t *line = (string_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i)
+        command_destroy(command_create(string_get_cstr(line), string_get_length(line), 0));
+}
+
+static void bench_compile_corpus(void *data, long long n) {
+    command_t **commands = (command_t**)data;
+    long long i;
+    for (i = 0; i < n; ++i)
+        program_destroy(program_compile(commands[i % BENCH_CORPUS_SIZE]));
+}
+
+static void bench_string_append_char(void *data, long long n) {
+    string_t *s = (string_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        if (!(i & 255))
+            string_clear(s);
+        string_append_char(s, 'a' + (i & 15));
+    }
+}
+
+static void bench_string_append_cstr(void *data, long long n) {
+    string_t *s = (string_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        if (!(i & 255))
+            string_clear(s);
+        string_append_cstr(s, "/usr/local/bin");
+    }
+}
+
+static void bench_string_append_cstrn(void *data, long long n) {
+    string_t *s = (string_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        if (!(i & 255))
+            string_clear(s);
+        string_append_cstrn(s, "/usr/local/bin", 10);
+    }
+}
+
+static void bench_string_append_string(void *data, long long n) {
+    string_t *s = (string_t*)data;
+    string_t *src = string_from_cstr("--option=value");
+    long long i;
+    for (i = 0; i < n; ++i) {
+        if (!(i & 255))
+            string_clear(s);
+        string_append_string(s, src);
+    }
+    string_destroy(src);
+}
+
+static void bench_string_build(void *data, long long n) {
+    (void)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        string_t *s = string_new();
+        string_append_cstr(s, "[user@host ");
+        string_append_cstr(s, "/home/user/projects/yas");
+        string_append_cstr(s, "]$ ");
+        string_destroy(s);
+    }
+}
+
+static void bench_argv_add_split(void *data, long long n) {
+    const char *s = (const char*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        argv_t *argv = argv_new();
+        argv_add_split(argv, s);
+        argv_destroy(argv);
+    }
+}
+
+static void bench_expand(void *data, long long n) {
+    command_t *command = (command_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        argv_t *argv = argv_new();
+        if (exec_expand(command, argv)) {
+            fprintf(stderr, "expansion failed\n");
+            exit(1);
+        }
+        argv_destroy(argv);
+    }
+}
+
+/*!
+    \internal
+    \brief Parser, compiler and expansion benchmarks
+*/
+static void bench_command() {
+    bench_run("parse_corpus", bench_parse_corpus, 0);
+    
+    size_t i;
+    string_t *line = string_new();
+    for (i = 0; i < 10000; ++i) {
+        char buffer[64];
+        snprintf(buffer, 64, "arg%zu \"quoted %zu\" $VAR%zu ", i, i, i);
+        string_append_cstr(line, buffer);
+    }
+    bench_run("parse_10k_args", bench_parse_string, line);
+    string_destroy(line);
+    
+    command_t *commands[BENCH_CORPUS_SIZE];
+    for (i = 0; i < BENCH_CORPUS_SIZE; ++i)
+        commands[i] = command_create(_bench_corpus[i], strlen(_bench_corpus[i]), 0);
+    bench_run("compile_corpus", bench_compile_corpus, commands);
+    for (i = 0; i < BENCH_CORPUS_SIZE; ++i)
+        command_destroy(commands[i]);
+    
+    var_set("BENCH_A", "alpha", VAR_EXPORT);
+    var_set("BENCH_B", "beta gamma", VAR_EXPORT);
+    var_set("BENCH_C", "/usr/local/share/doc", VAR_EXPORT);
+    static const char *cat = "echo pre\"$BENCH_A/x\"mid$BENCH_B\"q $BENCH_C\"post a b c";
+    command_t *command = command_create(cat, strlen(cat), 0);
+    bench_run("expand_cat", bench_expand, command);
+    command_destroy(command);
+    
+    line = string_from_cstr("echo ");
+    for (i = 0; i < 16; ++i)
+        string_append_cstr(line, i & 1 ? "\"-$BENCH_A-\"" : "$BENCH_C/");
+    command = command_create(string_get_cstr(line), string_get_length(line), 0);
+    bench_run("expand_cat_32", bench_expand, command);
+    command_destroy(command);
+    string_destroy(line);
+    
+    /* a large environment, with the variables referenced defined last */
+    for (i = 0; i < 500; ++i) {
+        char name[32];
+        snprintf(name, 32, "BENCH_V%zu", i);
+        var_set(name, "value", VAR_EXPORT);
+    }
+    static const char *vars = "echo $BENCH_V497 $BENCH_V498 $BENCH_V499 $BENCH_MISSING";
+    command = command_create(vars, strlen(vars), 0);
+    bench_run("expand_var_500", bench_expand, command);
+    command_destroy(command);
+    
+    static const char *arith = "echo $((BENCH_V499 * 3 + (BENCH_V498 << 2) % 7 - (1 ? 2 : 0)))";
+    var_set("BENCH_V498", "12", 0);
+    var_set("BENCH_V499", "34", 0);
+    command = command_create(arith, strlen(arith), 0);
+    bench_run("expand_arith", bench_expand, command);
+    command_destroy(command);
+}
+
+/*!
+    \internal
+    \brief Dynamic string benchmarks
+*/
+static void bench_string() {
+    string_t *s = string_new();
+    bench_run("string_append_char", bench_string_append_char, s);
+    bench_run("string_append_cstr", bench_string_append_cstr, s);
+    bench_run("string_append_cstrn", bench_string_append_cstrn, s);
+    bench_run("string_append_string", bench_string_append_string, s);
+    string_destroy(s);
+    bench_run("string_build", bench_string_build, 0);
+}
+
+/*!
+    \internal
+    \brief Field splitting and glob expansion benchmarks
+*/
+static void bench_argv() {
+    bench_run("argv_add_split_plain", bench_argv_add_split,
+              "gcc -O2 -Wall -Wextra -o yas memory.o arena.o dstring.o");
+    
+    char dir[] = "/tmp/yas_bench.XXXXXX";
+    if (!mkdtemp(dir))
+        return;
+    char path[64];
+    int i;
+    for (i = 0; i < 64; ++i) {
+        snprintf(path, 64, "%s/f%02i.txt", dir, i);
+        close(open(path, O_WRONLY | O_CREAT, 0644));
+    }
+    snprintf(path, 64, "%s/f*.txt", dir);
+    bench_run("argv_add_split_glob", bench_argv_add_split, path);
+    for (i = 0; i < 64; ++i) {
+        snprintf(path, 64, "%s/f%02i.txt", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+static void bench_path_lookup(void *data, long long n) {
+    const char *name = (const char*)data;
+    long long i;
+    for (i = 0; i < n; ++i)
+        path_lookup(name);
+}
+
+/*!
+    \internal
+    \brief Command name resolution, with and without the hash table
+*/
+static void bench_path() {
+    bench_run("path_lookup_hashed", bench_path_lookup, "true");
+    bench_run("path_lookup_missing_hashed", bench_path_lookup, "no_such_command");
+    option_set(OPTION_HASH, 0);
+    bench_run("path_lookup_search", bench_path_lookup, "true");
+    bench_run("path_lookup_missing_search", bench_path_lookup, "no_such_command");
+    option_set(OPTION_HASH, 1);
+}
+
+typedef struct {
+    command_t *command;
+    size_t length;
+} bench_subst_t;
+
+static void bench_subst(void *data, long long n) {
+    bench_subst_t *b = (bench_subst_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        argv_t *argv = argv_new();
+        if (exec_expand(b->command, argv)
+                || argv_get_argc(argv) != 2
+                || strlen(argv_get_argv(argv)[1]) != b->length) {
+            fprintf(stderr, "command substitution lost data\n");
+            exit(1);
+        }
+        argv_destroy(argv);
+    }
+}
+
+/*!
+    \internal
+    \brief Command substitution of a large output
+    \param mb Size of the output, in megabytes
+    The output is checked to be complete, minus the trailing newline.
+*/
+static void bench_substitution(size_t mb) {
+    char name[64], line[128];
+    snprintf(name, 64, "subst_%zuM", mb);
+    if (!mb || !bench_selected(name))
+        return;
+    snprintf(line, 128, "x \"$(yes | head -c %zu)\"", mb << 20);
+    bench_subst_t b;
+    b.command = command_create(line, strlen(line), 0);
+    b.length = (mb << 20) - 1;
+    bench_run(name, bench_subst, &b);
+    command_destroy(b.command);
+}
+
+static void bench_expand_quiet(void *data, long long n) {
+    command_t *command = (command_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i) {
+        argv_t *argv = argv_new();
+        exec_expand(command, argv);
+        argv_destroy(argv);
+    }
+}
+
+/*!
+    \internal
+    \brief Command substitutions that need no process, against ones that do
+*/
+static void bench_small_substitutions() {
+    static const char *lines[][2] = {
+        { "subst_builtin",  "x \"$(stats)\"" },
+        { "subst_file",     "x \"$(< /etc/hostname)\"" },
+        { "subst_external", "x \"$(/bin/true)\"" },
+        { "subst_pipeline", "x \"$(/bin/true | /bin/true)\"" }
+    };
+    size_t i;
+    for (i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        command_t *command = command_create(lines[i][1], strlen(lines[i][1]), 0);
+        bench_run(lines[i][0], bench_expand_quiet, command);
+        command_destroy(command);
+    }
+}
+
+static void bench_launch(void *data, long long n) {
+    command_t *command = (command_t*)data;
+    long long i;
+    for (i = 0; i < n; ++i)
+        exec_command(command, 0);
+}
+
+/*!
+    \internal
+    \brief Latency of external commands, with fork+exec and posix_spawn
+    The shell heap is grown first : the cost of fork grows with the memory
+    footprint of the parent process, unlike that of posix_spawn.
+*/
+static void bench_exec() {
+    static const size_t heap_mb[] = { 0, 64, 256, 1024 };
+    static const char *line = "/bin/true";
+    command_t *command;
+    size_t i;
+    static const char *lines[][2] = {
+        { "run_echo_builtin",  "echo x > /dev/null" },
+        { "run_echo_external", "/bin/echo x > /dev/null" },
+        { "run_test_builtin",  "[ -d /tmp ]" },
+        { "run_test_external", "/usr/bin/test -d /tmp" },
+        { "run_counter_arith", "n=$((n + 1))" },
+        { "run_counter_expr",  "n=$(expr $n + 1)" }
+    };
+    var_set("n", "0", 0);
+    for (i = 0; i < sizeof(lines) / sizeof(lines[0]); ++i) {
+        command = command_create(lines[i][1], strlen(lines[i][1]), 0);
+        bench_run(lines[i][0], bench_launch, command);
+        command_destroy(command);
+    }
+    
+    command = command_create(line, strlen(line), 0);
+    for (i = 0; i < sizeof(heap_mb) / sizeof(heap_mb[0]); ++i) {
+        char fork_name[64], spawn_name[64];
+        snprintf(fork_name, 64, "launch_fork_%zuM", heap_mb[i]);
+        snprintf(spawn_name, 64, "launch_spawn_%zuM", heap_mb[i]);
+        if (!bench_selected(fork_name) && !bench_selected(spawn_name))
+            continue;
+        char *heap = 0;
+        if (heap_mb[i]) {
+            heap = (char*)yas_malloc(heap_mb[i] << 20);
+            memset(heap, 1, heap_mb[i] << 20);
+        }
+        option_set(OPTION_SPAWN, 0);
+        bench_run(fork_name, bench_launch, command);
+        option_set(OPTION_SPAWN, 1);
+        bench_run(spawn_name, bench_launch, command);
+        yas_free(heap);
+    }
+    command_destroy(command);
+}
+
+/*!
+    \internal
+    \brief Throughput of a two-stage pipeline for several pipe buffer sizes
+    Each run moves 256 MB; ops are megabytes so that ops/s reads as MB/s.
+*/
+static void bench_pipe() {
+    static const char *sizes[] = { "4k", "64k", "256k", "1M" };
+    static const size_t mb = 256;
+    size_t i;
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        char name[64], line[160];
+        snprintf(name, 64, "pipe_throughput_%s", sizes[i]);
+        if (!bench_selected(name))
+            continue;
+        snprintf(line, 160, "head -c %zu /dev/zero |{%s} cat > /dev/null",
+                 mb << 20, sizes[i]);
+        command_t *command = command_create(line, strlen(line), 0);
+        unsigned long long a = _bench_allocs;
+        long long t = bench_now();
+        exec_command(command, 0);
+        bench_report(name, mb, bench_now() - t, _bench_allocs - a);
+        command_destroy(command);
+    }
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief Spawn a child process writing \a lines command lines into a pipe
+    \return the read end of the pipe
+*/
+static int bench_feed_lines(size_t lines, pid_t *pid) {
+    int fd[2];
+    if (pipe(fd)) {
+        perror("pipe");
+        exit(1);
+    }
+    *pid = fork();
+    if (!*pid) {
+        close(fd[0]);
+        FILE *f = fdopen(fd[1], "w");
+        size_t i;
+        for (i = 0; i < lines; ++i)
+            fprintf(f, "echo \"line %zu\" $HOME | grep -v foo > /dev/null\n", i);
+        fclose(f);
+        _exit(0);
+    }
+    close(fd[1]);
+    return fd[0];
+}
+
+/*!
+    \internal
+    \brief Reference line reader doing one read per byte, as the terminal backend does
+*/
+static size_t bench_read_bytewise(int fd) {
+    size_t lines = 0;
+    char c;
+    while (read(fd, &c, 1) == 1)
+        if (c == '\n')
+            ++lines;
+    return lines;
+}
+
+/*!
+    \internal
+    \brief Line input throughput on a pipe
+    \note Must run last : it consumes stdin.
+*/
+static void bench_input(size_t lines) {
+    pid_t pid;
+    int fd;
+    long long t;
+    unsigned long long a;
+    size_t n;
+    if (bench_selected("input_bytewise")) {
+        fd = bench_feed_lines(lines, &pid);
+        a = _bench_allocs;
+        t = bench_now();
+        n = bench_read_bytewise(fd);
+        bench_report("input_bytewise", n, bench_now() - t, _bench_allocs - a);
+        close(fd);
+        waitpid(pid, NULL, 0);
+    }
+    
+    if (bench_selected("input_buffered")) {
+        fd = bench_feed_lines(lines, &pid);
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+        int eof = 0;
+        n = 0;
+        a = _bench_allocs;
+        t = bench_now();
+        while (!eof) {
+            char *line = yas_readline("", &eof);
+            if (line)
+                ++n;
+            yas_free(line);
+        }
+        bench_report("input_buffered", n, bench_now() - t, _bench_allocs - a);
+        waitpid(pid, NULL, 0);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t lines = 100000, mb = 1;
+    while (argc > 2 && (!strcmp(argv[1], "-n") || !strcmp(argv[1], "-s"))) {
+        if (argv[1][1] == 'n')
+            lines = (size_t)atol(argv[2]);
+        else
+            mb = (size_t)atol(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
+    _bench_argc = argc - 1;
+    _bench_argv = argv + 1;
+    
+    fprintf(stdout, "name\tops\tns/op\tops/s\tallocs/op\n");
+    bench_command();
+    bench_string();
+    bench_argv();
+    bench_path();
+    bench_substitution(mb);
+    bench_small_substitutions();
+    bench_exec();
+    bench_pipe();
+    bench_input(lines);
+    return 0;
+}
@@ -0,0 +1,1346 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#define _GNU_SOURCE
+#include "builtin.h"
+
+/*!
+    \file builtin.c
+    \brief Implementation of builtin commands
+*/
+
+#include "memory.h"
+#include "dstring.h"
+#include "exec.h"
+#include "options.h"
+#include "cache.h"
+#include "path.h"
+#include "var.h"
+#include "util.h"
+#include "input.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/*!
+    \internal
+    \brief Implementation of the : and true builtins
+*/
+static int builtin_true(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt; (void)n; (void)d;
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the false builtin
+*/
+static int builtin_false(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt; (void)n; (void)d;
+    return 1;
+}
+
+/*!
+    \internal
+    \brief Implementation of the cd builtin
+    cd [dir]
+*/
+static int builtin_cd(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    if (n > 1) {
+        if (chdir(d[1])) {
+            fprintf(stderr, "No such directory : %s\n", d[1]);
+            return 1;
+        }
+        return 0;
+    }
+    char *homedir = get_homedir();
+    if (!homedir) {
+        fprintf(stderr, "Unable to find home directory\n");
+        return 1;
+    }
+    int ret = chdir(homedir) ? 1 : 0;
+    yas_free(homedir);
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Implementation of the exit builtin
+    exit [status]
+    The exit status of the shell is the one of the last command when none
+    is given.
+*/
+static int builtin_exit(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    if (n > 1) {
+        char *end;
+        long status = strtol(d[1], &end, 10);
+        if (!*d[1] || *end) {
+            fprintf(stderr, "exit: %s: numeric argument required\n", d[1]);
+            status = 2;
+        }
+        exec_set_status(status & 0xff);
+    }
+    return BUILTIN_EXIT;
+}
+
+/*!
+    \internal
+    \brief Implementation of the pwd builtin
+*/
+static int builtin_pwd(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt; (void)n; (void)d;
+    char *pwd = get_pwd();
+    if (!pwd) {
+        fprintf(stderr, "pwd: %s\n", strerror(errno));
+        return 1;
+    }
+    fputs(pwd, stdout);
+    fputc('\n', stdout);
+    yas_free(pwd);
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the list_tasks (aka liste_ps) builtin
+*/
+static int builtin_list_tasks(builtin_context_t *cxt, size_t n, char **d) {
+    (void)n; (void)d;
+    size_t i, count = cxt->tasklist ? task_list_get_size(cxt->tasklist) : 0;
+    for (i = 0; i < count; ++i)
+        task_inspect(task_list_get_task(cxt->tasklist, i));
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the set builtin
+    set [-o|+o name[=value]]...
+*/
+static int builtin_set(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    size_t i;
+    if (n < 2 || (n == 2 && !strcmp(d[1], "-o"))) {
+        int id;
+        for (id = 0; id < OPTION_COUNT; ++id) {
+            if (option_is_boolean(id))
+                fprintf(stdout, "%-16s%s\n", option_name(id), option_get(id) ? "on" : "off");
+            else
+                fprintf(stdout, "%-16s%i\n", option_name(id), option_get(id));
+        }
+        return 0;
+    }
+    for (i = 1; i < n; ++i) {
+        int enable = !strcmp(d[i], "-o");
+        if ((!enable && strcmp(d[i], "+o")) || i + 1 >= n) {
+            fprintf(stderr, "set: usage: set [-o|+o name[=value]]...\n");
+            return 2;
+        }
+        char *name = d[++i];
+        char *value = strchr(name, '=');
+        if (value)
+            *(value++) = 0;
+        int id = option_find(name);
+        if (id < 0) {
+            fprintf(stderr, "set: unknown option : %s\n", name);
+            return 1;
+        }
+        if (value && !option_is_boolean(id) && enable) {
+            option_set(id, atoi(value));
+        } else if (!value && option_is_boolean(id)) {
+            option_set(id, enable);
+        } else {
+            fprintf(stderr, "set: invalid value for option %s\n", name);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the stats builtin
+    Prints internal counters in a "name value" format
+*/
+static int builtin_stats(builtin_context_t *cxt, size_t n, char **d) {
+    (void)n; (void)d;
+    fprintf(stdout, "cache.entries %zu\n", command_cache_size());
+    fprintf(stdout, "cache.hits %llu\n", command_cache_hits());
+    fprintf(stdout, "cache.misses %llu\n", command_cache_misses());
+    fprintf(stdout, "path.entries %zu\n", path_size());
+    fprintf(stdout, "path.hits %llu\n", path_hits());
+    fprintf(stdout, "path.misses %llu\n", path_misses());
+    fprintf(stdout, "jobs.running %zu\n", task_list_count_running(cxt->tasklist));
+    fprintf(stdout, "jobs.queued %zu\n", task_list_count_queued(cxt->tasklist));
+    fprintf(stdout, "jobs.queued_total %llu\n", task_list_queued_total(cxt->tasklist));
+    fprintf(stdout, "jobs.wait_ms_total %lld\n", task_list_wait_total(cxt->tasklist) / 1000);
+    fprintf(stdout, "jobs.wait_ms_max %lld\n", task_list_wait_max(cxt->tasklist) / 1000);
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the hash builtin
+    hash [-r] [-d] [name...]
+*/
+static int builtin_hash(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    size_t i;
+    int ret = 0;
+    if (n < 2) {
+        path_inspect();
+        return 0;
+    } else if (!strcmp(d[1], "-r")) {
+        path_clear();
+        return 0;
+    }
+    int forget = !strcmp(d[1], "-d");
+    for (i = forget ? 2 : 1; i < n; ++i) {
+        path_forget(d[i]);
+        if (!forget && !path_lookup(d[i])) {
+            fprintf(stderr, "hash: %s: not found\n", d[i]);
+            ret = 1;
+        }
+    }
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Add attributes to variables, assigning them if a value is given
+    Variables are listed when no name is given.
+*/
+static int builtin_declare(size_t n, char **d, int flags) {
+    size_t i;
+    int ret = 0;
+    if (n < 2 || (n == 2 && !strcmp(d[1], "-p"))) {
+        var_inspect(flags);
+        return 0;
+    }
+    for (i = 1; i < n; ++i)
+        if (strchr(d[i], '=') ? var_assign(d[i], flags) : var_set(d[i], 0, flags))
+            ret = 1;
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Implementation of the export builtin
+    export [-p] [name[=value]...]
+*/
+static int builtin_export(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    return builtin_declare(n, d, VAR_EXPORT);
+}
+
+/*!
+    \internal
+    \brief Implementation of the readonly builtin
+    readonly [-p] [name[=value]...]
+*/
+static int builtin_readonly(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    return builtin_declare(n, d, VAR_READONLY);
+}
+
+/*!
+    \internal
+    \brief Implementation of the unset builtin
+    unset name...
+*/
+static int builtin_unset(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    size_t i;
+    int ret = 0;
+    for (i = 1; i < n; ++i)
+        if (var_unset(d[i]))
+            ret = 1;
+    return ret;
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief Interpret the backslash escape sequence at the start of \a s
+    \param s Escape sequence, without the leading backslash
+    \param octal0 whether octal sequences start with a 0 (\0nnn, as for echo
+    and %b) or not (\nnn, as in printf formats)
+    \param c set to the resulting character, -1 for \c
+    \return number of characters consumed
+*/
+static size_t builtin_unescape(const char *s, int octal0, int *c) {
+    size_t i = 0;
+    switch (*s) {
+        case 'a': *c = '\a'; return 1;
+        case 'b': *c = '\b'; return 1;
+        case 'c': *c = -1; return 1;
+        case 'e': *c = 27; return 1;
+        case 'f': *c = '\f'; return 1;
+        case 'n': *c = '\n'; return 1;
+        case 'r': *c = '\r'; return 1;
+        case 't': *c = '\t'; return 1;
+        case 'v': *c = '\v'; return 1;
+        case '\\': *c = '\\'; return 1;
+        case 'x':
+            *c = 0;
+            for (i = 1; i < 3 && isxdigit((unsigned char)s[i]); ++i)
+                *c = *c * 16 + (isdigit((unsigned char)s[i])
+                                ? s[i] - '0'
+                                : (tolower((unsigned char)s[i]) - 'a' + 10));
+            if (i > 1)
+                return i;
+            break;
+        default:
+            if (*s >= '0' && *s <= '7') {
+                size_t start = octal0 && *s == '0' ? 1 : 0;
+                *c = 0;
+                for (i = start; i < start + 3 && s[i] >= '0' && s[i] <= '7'; ++i)
+                    *c = *c * 8 + (s[i] - '0');
+                *c &= 0xFF;
+                return i;
+            }
+            break;
+    }
+    /* unknown sequences are kept as is */
+    *c = '\\';
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Write a string on stdout, interpreting backslash escapes
+    \return 1 if output must stop (\c), 0 otherwise
+*/
+static int builtin_put_escaped(const char *s, int octal0) {
+    while (*s) {
+        if (*s != '\\' || !s[1]) {
+            fputc(*(s++), stdout);
+            continue;
+        }
+        int c;
+        size_t n = builtin_unescape(++s, octal0, &c);
+        if (c == -1)
+            return 1;
+        fputc(c, stdout);
+        s += n;
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the echo builtin
+    echo [-neE] [arg...]
+    -n suppresses the trailing newline, -e enables the interpretation of
+    backslash escapes and -E disables it (default).
+*/
+static int builtin_echo(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    size_t i;
+    int newline = 1, escapes = 0;
+    for (i = 1; i < n && d[i][0] == '-' && d[i][1]; ++i) {
+        const char *o = d[i] + 1;
+        while (*o == 'n' || *o == 'e' || *o == 'E')
+            ++o;
+        if (*o)
+            break;
+        for (o = d[i] + 1; *o; ++o) {
+            if (*o == 'n')
+                newline = 0;
+            else
+                escapes = *o == 'e';
+        }
+    }
+    for (; i < n; ++i) {
+        if (!escapes)
+            fputs(d[i], stdout);
+        else if (builtin_put_escaped(d[i], 1))
+            return 0;
+        if (i + 1 < n)
+            fputc(' ', stdout);
+    }
+    if (newline)
+        fputc('\n', stdout);
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Convert a printf argument to an integer
+    Arguments starting with a quote stand for the value of the next character.
+*/
+static intmax_t builtin_printf_int(const char *s, int *status) {
+    if (*s == '\'' || *s == '\"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    intmax_t v = strtoimax(s, &end, 0);
+    if (end == s || *end || errno) {
+        fprintf(stderr, "printf: %s: invalid number\n", s);
+        *status = 1;
+    }
+    return v;
+}
+
+static double builtin_printf_double(const char *s, int *status) {
+    if (*s == '\'' || *s == '\"')
+        return (unsigned char)s[1];
+    char *end;
+    errno = 0;
+    double v = strtod(s, &end);
+    if (end == s || *end || errno) {
+        fprintf(stderr, "printf: %s: invalid number\n", s);
+        *status = 1;
+    }
+    return v;
+}
+
+/*!
+    \internal
+    \brief Output a printf format once
+    \param fmt Format
+    \param n number of arguments
+    \param d arguments
+    \param arg index of the next argument to consume, updated
+    \param status set to 1 on invalid arguments
+    \return 1 if output must stop (\c), 0 otherwise
+*/
+static int builtin_printf_format(const char *fmt, size_t n, char **d, size_t *arg, int *status) {
+    while (*fmt) {
+        if (*fmt == '\\' && fmt[1]) {
+            int c;
+            size_t k = builtin_unescape(++fmt, 0, &c);
+            if (c == -1)
+                return 1;
+            fputc(c, stdout);
+            fmt += k;
+            continue;
+        } else if (*fmt != '%') {
+            fputc(*(fmt++), stdout);
+            continue;
+        } else if (fmt[1] == '%') {
+            fputc('%', stdout);
+            fmt += 2;
+            continue;
+        }
+        /* conversion specification : copy it, replacing '*' by their value */
+        char spec[64];
+        size_t k = 0;
+        spec[k++] = *(fmt++);
+        while (*fmt && strchr("-+ #0", *fmt) && k < 16)
+            spec[k++] = *(fmt++);
+        int part;
+        for (part = 0; part < 2; ++part) {
+            if (part && *fmt == '.')
+                spec[k++] = *(fmt++);
+            if (*fmt == '*') {
+                const char *a = *arg < n ? d[(*arg)++] : "0";
+                k += snprintf(spec + k, 16, "%i", (int)builtin_printf_int(a, status));
+                ++fmt;
+            } else {
+                while (isdigit((unsigned char)*fmt) && k < 40)
+                    spec[k++] = *(fmt++);
+            }
+        }
+        char conv = *fmt;
+        if (!conv) {
+            fprintf(stderr, "printf: missing format character\n");
+            *status = 1;
+            return 1;
+        }
+        ++fmt;
+        const char *a = *arg < n ? d[(*arg)++] : 0;
+        if (strchr("diouxX", conv)) {
+            spec[k++] = 'j';
+            spec[k++] = conv;
+            spec[k] = 0;
+            intmax_t v = a ? builtin_printf_int(a, status) : 0;
+            if (conv == 'd' || conv == 'i')
+                fprintf(stdout, spec, v);
+            else
+                fprintf(stdout, spec, (uintmax_t)v);
+        } else if (strchr("feEgGaA", conv)) {
+            spec[k++] = conv;
+            spec[k] = 0;
+            fprintf(stdout, spec, a ? builtin_printf_double(a, status) : 0.0);
+        } else if (conv == 'c') {
+            spec[k++] = 'c';
+            spec[k] = 0;
+            if (a && *a)
+                fprintf(stdout, spec, *a);
+        } else if (conv == 's') {
+            spec[k++] = 's';
+            spec[k] = 0;
+            fprintf(stdout, spec, a ? a : "");
+        } else if (conv == 'b') {
+            if (a && builtin_put_escaped(a, 1))
+                return 1;
+        } else {
+            fprintf(stderr, "printf: %%%c: invalid conversion\n", conv);
+            *status = 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the printf builtin
+    printf format [arg...]
+    The format is reused as long as there are arguments left.
+*/
+static int builtin_printf(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    if (n < 2) {
+        fprintf(stderr, "printf: usage: printf format [arg...]\n");
+        return 2;
+    }
+    int status = 0;
+    size_t arg = 2, first;
+    do {
+        first = arg;
+        if (builtin_printf_format(d[1], n, d, &arg, &status))
+            break;
+    } while (arg < n && arg > first);
+    return status;
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief State of the evaluation of a test expression
+*/
+typedef struct {
+    char **d;
+    size_t pos;
+    size_t end;
+    int error;
+} test_state_t;
+
+static int test_or(test_state_t *t);
+
+static int test_is_unary(const char *op) {
+    return op[0] == '-' && op[1] && !op[2] && strchr("bcdefghLknprsStuwxzOG", op[1]);
+}
+
+static int test_is_binary(const char *op) {
+    static const char *ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef", 0
+    };
+    const char **o;
+    for (o = ops; *o; ++o)
+        if (!strcmp(*o, op))
+            return 1;
+    return 0;
+}
+
+static long long test_integer(test_state_t *t, const char *s) {
+    char *end;
+    errno = 0;
+    while (isspace((unsigned char)*s))
+        ++s;
+    long long v = strtoll(s, &end, 10);
+    while (isspace((unsigned char)*end))
+        ++end;
+    if (end == s || *end || errno) {
+        fprintf(stderr, "test: %s: integer expression expected\n", s);
+        t->error = 1;
+    }
+    return v;
+}
+
+static int test_unary(test_state_t *t, char op, const char *a) {
+    struct stat st;
+    if (op == 'n')
+        return *a != 0;
+    else if (op == 'z')
+        return *a == 0;
+    else if (op == 't')
+        return isatty((int)test_integer(t, a));
+    else if (op == 'r')
+        return !access(a, R_OK);
+    else if (op == 'w')
+        return !access(a, W_OK);
+    else if (op == 'x')
+        return !access(a, X_OK);
+    else if (op == 'h' || op == 'L')
+        return !lstat(a, &st) && S_ISLNK(st.st_mode);
+    if (stat(a, &st))
+        return 0;
+    switch (op) {
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+        default: break;
+    }
+    return 0;
+}
+
+static int test_binary(test_state_t *t, const char *a, const char *op, const char *b) {
+    if (!strcmp(op, "=") || !strcmp(op, "=="))
+        return !strcmp(a, b);
+    else if (!strcmp(op, "!="))
+        return strcmp(a, b) != 0;
+    else if (!strcmp(op, "<"))
+        return strcmp(a, b) < 0;
+    else if (!strcmp(op, ">"))
+        return strcmp(a, b) > 0;
+    if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef")) {
+        struct stat sa, sb;
+        int ea = stat(a, &sa), eb = stat(b, &sb);
+        if (!strcmp(op, "-ef"))
+            return !ea && !eb && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+        else if (!strcmp(op, "-nt"))
+            return !ea && (eb || sa.st_mtime > sb.st_mtime);
+        return !eb && (ea || sa.st_mtime < sb.st_mtime);
+    }
+    long long x = test_integer(t, a), y = test_integer(t, b);
+    if (!strcmp(op, "-eq"))
+        return x == y;
+    else if (!strcmp(op, "-ne"))
+        return x != y;
+    else if (!strcmp(op, "-lt"))
+        return x < y;
+    else if (!strcmp(op, "-le"))
+        return x <= y;
+    else if (!strcmp(op, "-gt"))
+        return x > y;
+    return x >= y;
+}
+
+static int test_primary(test_state_t *t) {
+    if (t->pos >= t->end) {
+        fprintf(stderr, "test: argument expected\n");
+        t->error = 1;
+        return 0;
+    }
+    char **d = t->d + t->pos;
+    size_t left = t->end - t->pos;
+    if (left >= 3 && test_is_binary(d[1])) {
+        t->pos += 3;
+        return test_binary(t, d[0], d[1], d[2]);
+    } else if (left >= 2 && test_is_unary(d[0])) {
+        t->pos += 2;
+        return test_unary(t, d[0][1], d[1]);
+    } else if (left >= 3 && !strcmp(d[0], "(")) {
+        ++t->pos;
+        int v = test_or(t);
+        if (t->pos >= t->end || strcmp(t->d[t->pos], ")")) {
+            if (!t->error)
+                fprintf(stderr, "test: ')' expected\n");
+            t->error = 1;
+        }
+        ++t->pos;
+        return v;
+    }
+    ++t->pos;
+    return *d[0] != 0;
+}
+
+static int test_not(test_state_t *t) {
+    if (t->end - t->pos >= 2 && !strcmp(t->d[t->pos], "!")) {
+        ++t->pos;
+        return !test_not(t);
+    }
+    return test_primary(t);
+}
+
+static int test_and(test_state_t *t) {
+    int v = test_not(t);
+    while (!t->error && t->pos + 1 < t->end && !strcmp(t->d[t->pos], "-a")) {
+        ++t->pos;
+        v = test_not(t) && v;
+    }
+    return v;
+}
+
+static int test_or(test_state_t *t) {
+    int v = test_and(t);
+    while (!t->error && t->pos + 1 < t->end && !strcmp(t->d[t->pos], "-o")) {
+        ++t->pos;
+        v = test_and(t) || v;
+    }
+    return v;
+}
+
+/*!
+    \internal
+    \brief Implementation of the test and [ builtins
+    \return 0 if the expression is true, 1 if it is false, 2 on error
+*/
+static int builtin_test(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    if (!strcmp(d[0], "[")) {
+        if (strcmp(d[n - 1], "]")) {
+            fprintf(stderr, "[: missing ]\n");
+            return 2;
+        }
+        --n;
+    }
+    test_state_t t;
+    t.d = d;
+    t.pos = 1;
+    t.end = n;
+    t.error = 0;
+    if (n < 2)
+        return 1;
+    int v = test_or(&t);
+    if (!t.error && t.pos < t.end) {
+        fprintf(stderr, "test: %s: unexpected argument\n", d[t.pos]);
+        t.error = 1;
+    }
+    return t.error ? 2 : !v;
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief Resource limits known to the ulimit builtin
+*/
+static const struct {
+    char option;
+    int resource;
+    rlim_t unit;
+    const char *name;
+} _ulimits[] = {
+    { 'c', RLIMIT_CORE,    512,  "core file size (blocks)" },
+    { 'd', RLIMIT_DATA,    1024, "data seg size (kbytes)" },
+    { 'f', RLIMIT_FSIZE,   512,  "file size (blocks)" },
+    { 'l', RLIMIT_MEMLOCK, 1024, "max locked memory (kbytes)" },
+    { 'n', RLIMIT_NOFILE,  1,    "open files" },
+    { 's', RLIMIT_STACK,   1024, "stack size (kbytes)" },
+    { 't', RLIMIT_CPU,     1,    "cpu time (seconds)" },
+    { 'u', RLIMIT_NPROC,   1,    "max user processes" },
+    { 'v', RLIMIT_AS,      1024, "virtual memory (kbytes)" }
+};
+
+/*!
+    \internal
+    \brief Print a resource limit, in the unit of the ulimit builtin
+*/
+static void builtin_ulimit_print(rlim_t value, rlim_t unit) {
+    if (value == RLIM_INFINITY)
+        fprintf(stdout, "unlimited\n");
+    else
+        fprintf(stdout, "%llu\n", (unsigned long long)(value / unit));
+}
+
+/*!
+    \internal
+    \brief Implementation of the ulimit builtin
+    ulimit [-H|-S] [-a | -c|-d|-f|-l|-n|-s|-t|-u|-v [limit|unlimited]]
+    Limits apply to the shell and are inherited by the commands it starts.
+    Without -H or -S, both the soft and hard limits are set and the soft
+    limit is printed. The file size (-f) is the default resource.
+*/
+static int builtin_ulimit(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    const size_t count = sizeof(_ulimits) / sizeof(_ulimits[0]);
+    int soft = 0, hard = 0, all = 0;
+    size_t i, r = 2;
+    for (i = 1; i < n && d[i][0] == '-' && d[i][1]; ++i) {
+        const char *o;
+        for (o = d[i] + 1; *o; ++o) {
+            size_t k;
+            if (*o == 'S') {
+                soft = 1;
+            } else if (*o == 'H') {
+                hard = 1;
+            } else if (*o == 'a') {
+                all = 1;
+            } else {
+                for (k = 0; k < count && _ulimits[k].option != *o; ++k)
+                    ;
+                if (k == count) {
+                    fprintf(stderr, "ulimit: invalid option : -%c\n", *o);
+                    return 2;
+                }
+                r = k;
+            }
+        }
+    }
+    struct rlimit limit;
+    if (all) {
+        for (r = 0; r < count; ++r) {
+            if (getrlimit(_ulimits[r].resource, &limit))
+                continue;
+            fprintf(stdout, "%-28s(-%c) ", _ulimits[r].name, _ulimits[r].option);
+            builtin_ulimit_print(hard ? limit.rlim_max : limit.rlim_cur, _ulimits[r].unit);
+        }
+        return 0;
+    }
+    if (getrlimit(_ulimits[r].resource, &limit)) {
+        fprintf(stderr, "ulimit: %s\n", strerror(errno));
+        return 1;
+    }
+    if (i >= n) {
+        builtin_ulimit_print(hard ? limit.rlim_max : limit.rlim_cur, _ulimits[r].unit);
+        return 0;
+    }
+    rlim_t value = RLIM_INFINITY;
+    if (strcmp(d[i], "unlimited")) {
+        char *end;
+        unsigned long long v = strtoull(d[i], &end, 10);
+        if (end == d[i] || *end || d[i][0] == '-') {
+            fprintf(stderr, "ulimit: invalid limit : %s\n", d[i]);
+            return 2;
+        }
+        value = (rlim_t)v * _ulimits[r].unit;
+    }
+    if (!soft && !hard)
+        soft = hard = 1;
+    if (soft)
+        limit.rlim_cur = value;
+    if (hard)
+        limit.rlim_max = value;
+    if (setrlimit(_ulimits[r].resource, &limit)) {
+        fprintf(stderr, "ulimit: %s\n", strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief A running job of the parallel builtin
+*/
+typedef struct {
+    pid_t pid;
+    int fd;
+    task_t *task;
+} parallel_job_t;
+
+/*!
+    \internal
+    \return a file to collect the output of a job into, -1 on failure
+*/
+static int parallel_output_fd() {
+    int fd = memfd_create("yas-parallel", MFD_CLOEXEC);
+    if (fd == -1) {
+        FILE *f = tmpfile();
+        if (f) {
+            fd = fcntl(fileno(f), F_DUPFD_CLOEXEC, 0);
+            fclose(f);
+        }
+    }
+    return fd;
+}
+
+/*!
+    \internal
+    \brief Build the command line of a job
+    Every "{}" in the template is replaced by the argument. The argument is
+    appended when the template has no "{}".
+*/
+static argv_t* parallel_job_argv(size_t n, char **tmpl, const char *arg) {
+    argv_t *argv = argv_new();
+    string_t *word = string_new();
+    int replaced = 0;
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        const char *s = tmpl[i], *p;
+        string_clear(word);
+        while ((p = strstr(s, "{}"))) {
+            string_append_cstrn(word, s, p - s);
+            string_append_cstr(word, arg);
+            s = p + 2;
+            replaced = 1;
+        }
+        string_append_cstr(word, s);
+        argv_add(argv, string_get_length(word) ? string_get_cstr(word) : "");
+    }
+    if (!replaced)
+        argv_add(argv, arg);
+    string_destroy(word);
+    return argv;
+}
+
+/*!
+    \internal
+    \brief Reap a finished job and print its output in one piece
+    \return exit status of the job
+*/
+static int parallel_job_finish(builtin_context_t *cxt, parallel_job_t *job, int stat) {
+    /* the output file shares its offset with the job, so it is the size of the output */
+    off_t sz = lseek(job->fd, 0, SEEK_CUR), off = 0;
+    fflush(stdout);
+    while (off < sz) {
+        char buffer[65536];
+        ssize_t r = pread(job->fd, buffer,
+                          sz - off < (off_t)sizeof(buffer) ? (size_t)(sz - off) : sizeof(buffer),
+                          off);
+        if (r <= 0 || write(STDOUT_FILENO, buffer, r) != r)
+            break;
+        off += r;
+    }
+    close(job->fd);
+    size_t i, n = cxt->tasklist ? task_list_get_size(cxt->tasklist) : 0;
+    for (i = 0; i < n; ++i) {
+        if (task_list_get_task(cxt->tasklist, i) == job->task) {
+            task_list_remove(cxt->tasklist, i);
+            break;
+        }
+    }
+    task_destroy(job->task);
+    job->pid = 0;
+    if (WIFEXITED(stat))
+        return WEXITSTATUS(stat);
+    return WIFSIGNALED(stat) ? 128 + WTERMSIG(stat) : 1;
+}
+
+/*!
+    \internal
+    \brief Wait for at least one job to finish
+    \return number of failed jobs among those that finished
+    SIGCHLD is blocked by the caller : it is consumed here instead of being
+    reported by the handler of the shell as the end of a background task.
+*/
+static int parallel_wait(builtin_context_t *cxt, parallel_job_t *jobs, size_t njobs, size_t *running) {
+    sigset_t chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    int failed = 0;
+    size_t before = *running;
+    while (*running == before) {
+        size_t i;
+        for (i = 0; i < njobs; ++i) {
+            int stat;
+            if (jobs[i].pid && waitpid(jobs[i].pid, &stat, WNOHANG) == jobs[i].pid) {
+                if (parallel_job_finish(cxt, jobs + i, stat))
+                    ++failed;
+                --*running;
+            }
+        }
+        if (*running == before) {
+            struct timespec timeout = { 0, 100000000 };
+            sigtimedwait(&chld, NULL, &timeout);
+        }
+    }
+    return failed;
+}
+
+/*!
+    \internal
+    \brief Implementation of the parallel builtin
+    parallel [-j jobs] command [arg...] [::: value...]
+    The command is run once per value, with at most \a jobs of them at a
+    time (one per CPU core by default). Values are read from the lines of
+    the standard input when there is no ":::". The output of each job is
+    printed in one piece when it finishes.
+    \return the number of failed jobs, up to 100
+*/
+static int builtin_parallel(builtin_context_t *cxt, size_t n, char **d) {
+    size_t i = 1, max = 0;
+    if (i < n && !strncmp(d[i], "-j", 2)) {
+        const char *s = d[i][2] ? d[i] + 2 : (i + 1 < n ? d[++i] : "");
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (!*s || *end || v <= 0) {
+            fprintf(stderr, "parallel: invalid number of jobs : %s\n", s);
+            return 2;
+        }
+        max = v;
+        ++i;
+    }
+    size_t cmd = i, ncmd = 0;
+    while (i < n && strcmp(d[i], ":::"))
+        ++i;
+    ncmd = i - cmd;
+    if (!ncmd) {
+        fprintf(stderr, "parallel: usage: parallel [-j jobs] command [arg...] [::: value...]\n");
+        return 2;
+    }
+    if (!max)
+        max = get_cpu_count();
+    if (!max)
+        max = 1;
+    
+    /* values : after ":::" or lines of the standard input */
+    string_t *input = 0;
+    char **values = 0;
+    size_t nvalues = 0;
+    if (i < n) {
+        values = d + i + 1;
+        nvalues = n - i - 1;
+    } else {
+        input = string_new();
+        char buffer[65536];
+        ssize_t r;
+        while ((r = read(STDIN_FILENO, buffer, sizeof(buffer))) > 0
+                || (r == -1 && errno == EINTR))
+            if (r > 0)
+                string_append_cstrn(input, buffer, r);
+        size_t len = string_get_length(input), alloc = 0;
+        char *s = string_get_cstr(input);
+        for (i = 0; i < len; ++i) {
+            size_t start = i;
+            while (i < len && s[i] != '\n')
+                ++i;
+            s[i] = 0;
+            if (nvalues == alloc) {
+                alloc = alloc ? 2 * alloc : 64;
+                values = (char**)yas_realloc(values, alloc * sizeof(char*));
+            }
+            values[nvalues++] = s + start;
+        }
+    }
+    
+    if (max > nvalues)
+        max = nvalues;
+    parallel_job_t *jobs = (parallel_job_t*)yas_malloc((max ? max : 1) * sizeof(parallel_job_t));
+    memset(jobs, 0, (max ? max : 1) * sizeof(parallel_job_t));
+    sigset_t chld, saved;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved);
+    size_t running = 0, next = 0;
+    int failed = 0;
+    while (next < nvalues || running) {
+        if (next < nvalues && running < max) {
+            parallel_job_t *job = jobs;
+            while (job->pid)
+                ++job;
+            argv_t *argv = parallel_job_argv(ncmd, d + cmd, values[next++]);
+            job->fd = parallel_output_fd();
+            job->pid = job->fd == -1 ? -1 : exec_argv(argv, -1, job->fd, cxt->tasklist);
+            if (job->pid == -1) {
+                if (job->fd != -1)
+                    close(job->fd);
+                argv_destroy(argv);
+                job->pid = 0;
+                ++failed;
+                continue;
+            }
+            job->task = task_new();
+            task_set_pid(job->task, job->pid);
+            task_set_argv(job->task, argv);
+            if (cxt->tasklist)
+                task_list_add(cxt->tasklist, job->task);
+            ++running;
+        } else {
+            failed += parallel_wait(cxt, jobs, max, &running);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    yas_free(jobs);
+    if (input) {
+        yas_free(values);
+        string_destroy(input);
+    }
+    return failed > 100 ? 100 : failed;
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief Shell side of a coprocess
+*/
+typedef struct {
+    char *name;
+    /* write end of the input of the coprocess, -1 in copies of the shell */
+    int to;
+    /* read end of the output of the coprocess */
+    int from;
+} coproc_t;
+
+static coproc_t *_coprocs = 0;
+static size_t _ncoprocs = 0;
+
+/*!
+    \internal
+    \brief Set the variable NAME_SUFFIX of a coprocess
+*/
+static void coproc_setvar(const char *name, const char *suffix, const char *fmt, long v) {
+    char var[128], value[32];
+    snprintf(var, sizeof(var), "%s_%s", name, suffix);
+    if (fmt) {
+        snprintf(value, sizeof(value), fmt, v);
+        var_set(var, value, 0);
+    } else {
+        var_unset(var);
+    }
+}
+
+/*!
+    \internal
+    \brief Close the shell side of a coprocess, which then sees the end of its input
+    \return 0 on success, 1 if there is no coprocess of that name
+*/
+static int coproc_close(const char *name) {
+    size_t i;
+    for (i = 0; i < _ncoprocs; ++i) {
+        if (strcmp(_coprocs[i].name, name))
+            continue;
+        if (_coprocs[i].to != -1)
+            close(_coprocs[i].to);
+        close(_coprocs[i].from);
+        coproc_setvar(name, "IN", 0, 0);
+        coproc_setvar(name, "OUT", 0, 0);
+        coproc_setvar(name, "PID", 0, 0);
+        yas_free(_coprocs[i].name);
+        _coprocs[i] = _coprocs[--_ncoprocs];
+        return 0;
+    }
+    return 1;
+}
+
+/*!
+    \brief Close the input of coprocesses in a copy of the shell running a
+    list, a pipeline or a substitution
+    Otherwise the copy would delay the end of input seen by a coprocess
+    after "coproc -c".
+*/
+void builtin_coproc_detach() {
+    size_t i;
+    for (i = 0; i < _ncoprocs; ++i) {
+        if (_coprocs[i].to != -1)
+            close(_coprocs[i].to);
+        _coprocs[i].to = -1;
+    }
+}
+
+/*!
+    \internal
+    \brief Implementation of the coproc builtin
+    coproc [-n name] command [arg...]
+    coproc -c [name]
+    The command is started in the background with its standard input and
+    output connected to pipes kept open by the shell, whose /dev/fd paths are
+    stored in NAME_IN (to write to) and NAME_OUT (to read from). NAME_PID is
+    the pid of the command. The default name is COPROC. With -c, the pipes
+    are closed : the command sees the end of its input, and the variables
+    are unset.
+    The pipes are close-on-exec : the paths are only valid in redirections,
+    which the shell opens itself, not as arguments of external commands.
+    Copies of the shell running lists, pipelines or substitutions do not
+    keep NAME_IN open.
+*/
+static int builtin_coproc(builtin_context_t *cxt, size_t n, char **d) {
+    const char *name = "COPROC";
+    int close_only = 0;
+    size_t i = 1;
+    for (; i < n && d[i][0] == '-'; ++i) {
+        if (!strcmp(d[i], "-c")) {
+            close_only = 1;
+        } else if (!strcmp(d[i], "-n") && i + 1 < n) {
+            name = d[++i];
+        } else if (!strcmp(d[i], "--")) {
+            ++i;
+            break;
+        } else {
+            name = "";
+            break;
+        }
+    }
+    if (close_only) {
+        if (i < n)
+            name = d[i];
+        if (coproc_close(name)) {
+            fprintf(stderr, "coproc: no coprocess named %s\n", name);
+            return 1;
+        }
+        return 0;
+    }
+    const char *c = name;
+    while (isalnum((unsigned char)*c) || *c == '_')
+        ++c;
+    if (i == n || *c || !*name || strlen(name) > 64) {
+        fprintf(stderr, "coproc: usage: coproc [-n name] command [arg...] | coproc -c [name]\n");
+        return 2;
+    }
+    int to[2], from[2];
+    if (pipe2(to, O_CLOEXEC)) {
+        fprintf(stderr, "coproc: %s\n", strerror(errno));
+        return 1;
+    }
+    if (pipe2(from, O_CLOEXEC)) {
+        fprintf(stderr, "coproc: %s\n", strerror(errno));
+        close(to[0]);
+        close(to[1]);
+        return 1;
+    }
+    argv_t *argv = argv_new();
+    for (; i < n; ++i)
+        argv_add(argv, d[i]);
+    sigset_t chld, saved;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved);
+    pid_t pid = exec_argv(argv, to[0], from[1], cxt->tasklist);
+    close(to[0]);
+    close(from[1]);
+    if (pid == -1) {
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+        close(to[1]);
+        close(from[0]);
+        argv_destroy(argv);
+        return 1;
+    }
+    if (cxt->tasklist) {
+        task_t *task = task_new();
+        task_set_pid(task, pid);
+        task_set_argv(task, argv);
+        task_list_add(cxt->tasklist, task);
+        fprintf(stderr, "[%zu] %u\n", task_list_get_size(cxt->tasklist), pid);
+    } else {
+        argv_destroy(argv);
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    
+    coproc_close(name);
+    _coprocs = (coproc_t*)yas_realloc(_coprocs, (_ncoprocs + 1) * sizeof(coproc_t));
+    _coprocs[_ncoprocs].name = yas_malloc(strlen(name) + 1);
+    strcpy(_coprocs[_ncoprocs].name, name);
+    _coprocs[_ncoprocs].to = to[1];
+    _coprocs[_ncoprocs].from = from[0];
+    ++_ncoprocs;
+    coproc_setvar(name, "IN", "/dev/fd/%ld", to[1]);
+    coproc_setvar(name, "OUT", "/dev/fd/%ld", from[0]);
+    coproc_setvar(name, "PID", "%ld", pid);
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Implementation of the read builtin
+    read [name...]
+    A line is read from the standard input, one byte at a time so that
+    nothing past it is consumed, e.g. from the output of a coprocess. When
+    the shell reads its commands from that input, lines it read ahead come
+    first. The line is split into words assigned to the variables, the last
+    one getting the rest of the line. REPLY is used when no name is given.
+    \return 1 at the end of the input
+*/
+static int builtin_read(builtin_context_t *cxt, size_t n, char **d) {
+    (void)cxt;
+    string_t *line = string_new();
+    int got = 0;
+    while (1) {
+        char c;
+        ssize_t r = yas_input_read(&c, 1);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r != 1 || c == '\n') {
+            got |= r == 1;
+            break;
+        }
+        got = 1;
+        string_append_char(line, c);
+    }
+    static char *reply[] = { "read", "REPLY" };
+    if (n < 2) {
+        n = 2;
+        d = reply;
+    }
+    char empty = 0;
+    char *s = string_get_length(line) ? string_get_cstr(line) : &empty;
+    size_t i;
+    for (i = 1; i < n; ++i) {
+        while (*s == ' ' || *s == '\t')
+            ++s;
+        char *end = s;
+        if (i + 1 < n) {
+            while (*end && *end != ' ' && *end != '\t')
+                ++end;
+        } else {
+            end += strlen(s);
+            while (end > s && (end[-1] == ' ' || end[-1] == '\t'))
+                --end;
+        }
+        char saved = *end;
+        *end = 0;
+        var_set(d[i], s, 0);
+        *end = saved;
+        s = end;
+    }
+    string_destroy(line);
+    return got ? 0 : 1;
+}
+
+/******************************************************************************/
+
+/* sorted by name, for bsearch */
+static const builtin_t _builtins[] = {
+    { ":",          BUILTIN_PURE, builtin_true       },
+    { "[",          BUILTIN_PURE, builtin_test       },
+    { "cd",         0,            builtin_cd         },
+    { "coproc",     0,            builtin_coproc     },
+    { "echo",       BUILTIN_PURE, builtin_echo       },
+    { "exit",       0,            builtin_exit       },
+    { "export",     0,            builtin_export     },
+    { "false",      BUILTIN_PURE, builtin_false      },
+    { "hash",       0,            builtin_hash       },
+    { "list_tasks", BUILTIN_PURE, builtin_list_tasks },
+    { "liste_ps",   BUILTIN_PURE, builtin_list_tasks },
+    { "parallel",   0,            builtin_parallel   },
+    { "printf",     BUILTIN_PURE, builtin_printf     },
+    { "pwd",        BUILTIN_PURE, builtin_pwd        },
+    { "read",       0,            builtin_read       },
+    { "readonly",   0,            builtin_readonly   },
+    { "set",        0,            builtin_set        },
+    { "stats",      BUILTIN_PURE, builtin_stats      },
+    { "test",       BUILTIN_PURE, builtin_test       },
+    { "true",       BUILTIN_PURE, builtin_true       },
+    { "ulimit",     0,            builtin_ulimit     },
+    { "unset",      0,            builtin_unset      }
+};
+
+static int builtin_compare(const void *name, const void *builtin) {
+    return strcmp((const char*)name, ((const builtin_t*)builtin)->name);
+}
+
+/*!
+    \brief Find a builtin command
+    \return the builtin command named \a name, 0 if there is none
+*/
+const builtin_t* builtin_find(const char *name) {
+    if (!name)
+        return 0;
+    return (const builtin_t*)bsearch(name,
+                                     _builtins,
+                                     sizeof(_builtins) / sizeof(_builtins[0]),
+                                     sizeof(builtin_t),
+                                     builtin_compare);
+}
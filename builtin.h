@@ -0,0 +1,62 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _BUILTIN_H_
+#define _BUILTIN_H_
+
+/*!
+    \file builtin.h
+    \brief Definition of builtin commands
+*/
+
+#include "task.h"
+
+#include <stddef.h>
+
+/*!
+    \brief Shell state available to builtin commands
+*/
+typedef struct _builtin_context {
+    task_list_t *tasklist;
+} builtin_context_t;
+
+/*!
+    \brief Implementation of a builtin command
+    \return exit status of the command, BUILTIN_EXIT to exit the shell
+*/
+typedef int (*builtin_fn_t)(builtin_context_t *cxt, size_t argc, char **argv);
+
+enum builtin_flags {
+    /*! no side effect on the shell : may run in the shell process even when
+        its output is captured */
+    BUILTIN_PURE = 1
+};
+
+enum {
+    BUILTIN_EXIT = -1
+};
+
+/*!
+    \brief Description of a builtin command
+*/
+typedef struct _builtin {
+    const char *name;
+    int flags;
+    builtin_fn_t run;
+} builtin_t;
+
+const builtin_t* builtin_find(const char *name);
+
+void builtin_coproc_detach();
+
+#endif /* _BUILTIN_H_ */
@@ -0,0 +1,208 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "cache.h"
+
+/*!
+    \file cache.c
+    \brief Implementation of the parsed command cache
+
+    Parsed commands are kept in a LRU list, indexed by a hash table keyed by
+    the text of the command line. Its capacity and whether it is used at all
+    are controlled by the cache_size and cache shell options.
+*/
+
+#include "memory.h"
+#include "options.h"
+
+#include <string.h>
+
+/*!
+    \internal
+    \brief Cached command line
+*/
+typedef struct _cache_entry {
+    unsigned long long hash;
+    size_t sz;
+    char *text;
+    command_t *command;
+    struct _cache_entry *chain;
+    struct _cache_entry *prev;
+    struct _cache_entry *next;
+} cache_entry_t;
+
+static cache_entry_t **_cache_buckets = 0;
+static size_t _cache_bucket_count = 0;
+static size_t _cache_size = 0;
+static cache_entry_t *_cache_head = 0;
+static cache_entry_t *_cache_tail = 0;
+static unsigned long long _cache_hits = 0;
+static unsigned long long _cache_misses = 0;
+
+/*!
+    \internal
+    \brief FNV-1a hash of the text of a command line
+*/
+static unsigned long long cache_hash(const char *str, size_t sz) {
+    unsigned long long h = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < sz; ++i) {
+        h ^= (unsigned char)str[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void cache_lru_unlink(cache_entry_t *e) {
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        _cache_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        _cache_tail = e->prev;
+    e->prev = e->next = 0;
+}
+
+static void cache_lru_push_front(cache_entry_t *e) {
+    e->prev = 0;
+    e->next = _cache_head;
+    if (_cache_head)
+        _cache_head->prev = e;
+    _cache_head = e;
+    if (!_cache_tail)
+        _cache_tail = e;
+}
+
+/*!
+    \internal
+    \brief Remove the least recently used entry
+*/
+static void cache_evict() {
+    cache_entry_t *e = _cache_tail;
+    if (!e)
+        return;
+    cache_lru_unlink(e);
+    cache_entry_t **b = &_cache_buckets[e->hash & (_cache_bucket_count - 1)];
+    while (*b != e)
+        b = &(*b)->chain;
+    *b = e->chain;
+    command_destroy(e->command);
+    yas_free(e->text);
+    yas_free(e);
+    --_cache_size;
+}
+
+/*!
+    \internal
+    \brief Make sure the hash table is large enough for \a capacity entries
+*/
+static void cache_reserve(size_t capacity) {
+    size_t n = 16;
+    while (n < 2 * capacity)
+        n *= 2;
+    if (n <= _cache_bucket_count)
+        return;
+    cache_entry_t **buckets = (cache_entry_t**)yas_malloc(n * sizeof(cache_entry_t*));
+    memset(buckets, 0, n * sizeof(cache_entry_t*));
+    cache_entry_t *e;
+    for (e = _cache_head; e; e = e->next) {
+        e->chain = buckets[e->hash & (n - 1)];
+        buckets[e->hash & (n - 1)] = e;
+    }
+    yas_free(_cache_buckets);
+    _cache_buckets = buckets;
+    _cache_bucket_count = n;
+}
+
+/*!
+    \brief Parse a command line, reusing a previously parsed tree when possible
+    \param str input data
+    \param sz size of input data
+    \param error parse error description, filled on failure (may be 0)
+    \return parsed representation of command line, 0 on parse error
+    The returned command_t may be shared with the cache and must be treated as
+    read-only. It must be released with command_destroy. Parse errors are
+    reported by command_create and never cached.
+*/
+command_t* command_cache_lookup(const char *str, size_t sz, command_error_t *error) {
+    size_t capacity = option_get(OPTION_CACHE) && option_get(OPTION_CACHE_SIZE) > 0
+                    ? (size_t)option_get(OPTION_CACHE_SIZE)
+                    : 0;
+    while (_cache_size > capacity)
+        cache_evict();
+    if (!capacity)
+        return command_create(str, sz, error);
+    
+    unsigned long long h = cache_hash(str, sz);
+    cache_entry_t *e = _cache_bucket_count
+                     ? _cache_buckets[h & (_cache_bucket_count - 1)]
+                     : 0;
+    while (e && !(e->hash == h && e->sz == sz && !memcmp(e->text, str, sz)))
+        e = e->chain;
+    if (e) {
+        ++_cache_hits;
+        cache_lru_unlink(e);
+        cache_lru_push_front(e);
+        return command_ref(e->command);
+    }
+    
+    ++_cache_misses;
+    command_t *command = command_create(str, sz, error);
+    if (!command)
+        return 0;
+    if (_cache_size == capacity)
+        cache_evict();
+    cache_reserve(capacity);
+    e = (cache_entry_t*)yas_malloc(sizeof(cache_entry_t));
+    e->hash = h;
+    e->sz = sz;
+    e->text = (char*)yas_malloc(sz ? sz : 1);
+    memcpy(e->text, str, sz);
+    e->command = command_ref(command);
+    e->chain = _cache_buckets[h & (_cache_bucket_count - 1)];
+    _cache_buckets[h & (_cache_bucket_count - 1)] = e;
+    cache_lru_push_front(e);
+    ++_cache_size;
+    return command;
+}
+
+/*!
+    \brief Drop all cached commands
+*/
+void command_cache_clear() {
+    while (_cache_size)
+        cache_evict();
+}
+
+/*!
+    \return the number of cached commands
+*/
+size_t command_cache_size() {
+    return _cache_size;
+}
+
+/*!
+    \return the number of lookups served from the cache
+*/
+unsigned long long command_cache_hits() {
+    return _cache_hits;
+}
+
+/*!
+    \return the number of lookups that required parsing
+*/
+unsigned long long command_cache_misses() {
+    return _cache_misses;
+}
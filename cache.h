@@ -0,0 +1,31 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*!
+    \file cache.h
+    \brief Definition of the parsed command cache
+*/
+
+#include "command.h"
+
+command_t* command_cache_lookup(const char *str, size_t sz, command_error_t *error);
+void command_cache_clear();
+
+size_t command_cache_size();
+unsigned long long command_cache_hits();
+unsigned long long command_cache_misses();
+
+#endif /* _CACHE_H_ */
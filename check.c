@@ -0,0 +1,162 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "check.h"
+
+/*!
+    \file check.c
+    \brief Implementation of parallel syntax checking
+    
+    Scripts are distributed among a pool of threads, one per CPU core, which
+    parse every command line without executing anything. Reports are
+    collected per script and printed in command line order once all threads
+    are done, so that the output does not depend on scheduling.
+*/
+
+#include "memory.h"
+#include "dstring.h"
+#include "command.h"
+#include "script.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <pthread.h>
+
+/*!
+    \internal
+    \brief Result of the syntax check of a single script
+*/
+typedef struct _check_job {
+    const char *name;
+    string_t *report;
+    int status;
+} check_job_t;
+
+/*!
+    \internal
+    \brief State shared by the threads of the pool
+*/
+typedef struct _check_pool {
+    pthread_mutex_t lock;
+    check_job_t *jobs;
+    size_t count;
+    size_t next;
+} check_pool_t;
+
+/*!
+    \internal
+    \brief Parse every command line of a script, recording all syntax errors
+*/
+static void check_script(check_job_t *job) {
+    char buffer[1024];
+    script_t *script = script_open(job->name);
+    if (!script) {
+        snprintf(buffer, sizeof(buffer), "yas: unable to read %s\n", job->name);
+        string_append_cstr(job->report, buffer);
+        job->status = 127;
+        return;
+    }
+    const char *line;
+    size_t line_sz;
+    while (script_next_line(script, &line, &line_sz)) {
+        if (!is_nontrivial(line, line_sz))
+            continue;
+        command_error_t error;
+        command_t *command = command_create(line, line_sz, &error);
+        while (!command && error.type == ERRTYPE_INCOMPLETE_HEREDOC) {
+            const char *next;
+            size_t next_sz;
+            if (!script_next_line(script, &next, &next_sz))
+                break;
+            line_sz = next + next_sz - line;
+            if (command_heredoc_ends(&error, next, next_sz))
+                command = command_create(line, line_sz, &error);
+        }
+        if (command) {
+            command_destroy(command);
+            continue;
+        }
+        snprintf(buffer, sizeof(buffer), "%s:%zu: syntax error @ %zu : %s\n",
+                 job->name,
+                 script_line_number(script),
+                 error.position,
+                 command_error_string(&error));
+        string_append_cstr(job->report, buffer);
+        job->status = 2;
+    }
+    script_close(script);
+}
+
+/*!
+    \internal
+    \brief Thread body : check scripts until none is left
+*/
+static void* check_worker(void *d) {
+    check_pool_t *pool = (check_pool_t*)d;
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        size_t i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count)
+            break;
+        check_script(&pool->jobs[i]);
+    }
+    return 0;
+}
+
+/*!
+    \brief Syntax check scripts without executing them
+    \param n number of scripts
+    \param files paths of the scripts
+    \return 0 if all scripts are valid, 2 on syntax error, 127 if a script
+    could not be read
+*/
+int check_scripts(int n, char **files) {
+    int i, status = 0;
+    check_pool_t pool;
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.count = (size_t)n;
+    pool.next = 0;
+    pool.jobs = (check_job_t*)yas_malloc(n * sizeof(check_job_t));
+    for (i = 0; i < n; ++i) {
+        pool.jobs[i].name = files[i];
+        pool.jobs[i].report = string_new();
+        pool.jobs[i].status = 0;
+    }
+    
+    int nthreads = get_cpu_count();
+    if (nthreads > n)
+        nthreads = n;
+    pthread_t *threads = (pthread_t*)yas_malloc(nthreads * sizeof(pthread_t));
+    int started = 0;
+    while (started < nthreads
+            && !pthread_create(&threads[started], NULL, check_worker, &pool))
+        ++started;
+    /* the calling thread takes its share of the work (or all of it if no thread could be created) */
+    check_worker(&pool);
+    for (i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    yas_free(threads);
+    
+    for (i = 0; i < n; ++i) {
+        check_job_t *job = &pool.jobs[i];
+        if (string_get_length(job->report))
+            fputs(string_get_cstr(job->report), stderr);
+        if (job->status > status)
+            status = job->status;
+        string_destroy(job->report);
+    }
+    yas_free(pool.jobs);
+    pthread_mutex_destroy(&pool.lock);
+    return status;
+}
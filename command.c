@@ -19,13 +19,21 @@
 */
 
 #include "memory.h"
+#include "arena.h"
 #include "dstring.h"
+#include "program.h"
+#include "arith.h"
 
 #include <ctype.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
 
+#if defined(__SSE2__) && !defined(YAS_NO_SIMD)
+#define YAS_PARSER_SSE2
+#include <emmintrin.h>
+#endif
+
 void indent_printf(size_t indent, const char *fmt, ...) {
     va_list va;
     va_start(va, fmt);
@@ -38,28 +46,52 @@ void indent_printf(size_t indent, const char *fmt, ...) {
 
 /*
     Command grammar (external textual representation) :
-    command_line = command ( ('|' | '&') command )*
-    command = argument+ ( '<' argument )? ( '>' argument )?
-    argument = string | '$' '(' command ')' | '$' variable
-    string = '"' ([^"] | '\' '"')* '"' | ([^"<>|&] | '\' ["<>|&])+
+    command_line = and_or ( (';' | '&') and_or )* (';' | '&')?
+    and_or = pipeline ( ('&&' | '||') pipeline )*
+    pipeline = command ( '|' pipe_size? command )*
+    pipe_size = '{' [0-9]+ ( 'k' | 'K' | 'm' | 'M' )? '}'
+    command = redirection* argument+ redirection* | redirection+
+    redirection = '<' argument | '>' argument | '<<<' argument | '<<' '-'? word
+                  (at most one input and one output)
+    argument = string | '$' '(' command_line ')' | '$' variable
+             | '<' '(' command_line ')' | '>' '(' command_line ')'
+    string = '"' ([^"] | '\' '"')* '"' | ([^"<>|&;] | '\' ["<>|&;])+
+    
+    The body of a here-document ('<<' word) follows the command line, up to a
+    line made of the word (after removal of leading tabs with '<<-'). It is
+    expanded like a quoted string, unless the word is quoted.
 */
 
 struct _command {
     int flags;
+    int refs;
     size_t argc;
+    size_t alloc;
     argument_t **argv;
     argument_t *in;
     argument_t *out;
+    size_t pipe_size;
+    /* source text of a background list or pipeline, shown in the task list */
+    const char *text;
+    arena_t *arena;
+    program_t *program;
 };
 
 enum command_flags {
     COMMAND_IS_BACKGROUND = 1,
-    COMMAND_IS_PIPECHAIN = 2
+    COMMAND_IS_PIPECHAIN = 2,
+    COMMAND_OWNS_ARENA = 4,
+    COMMAND_IN_DATA = 8,
+    COMMAND_IS_LIST = 16,
+    /* element of a list run only if the previous one succeeded (&&) or failed (||) */
+    COMMAND_AND = 32,
+    COMMAND_OR = 64
 };
 
 struct _argument {
     int type;
     size_t n;
+    size_t alloc;
     union {
         char *str;
         command_t *cmd;
@@ -70,14 +102,21 @@ struct _argument {
 /*!
     \internal
     \brief Create a new command_t
+    All memory used by the command is allocated from \a arena.
 */
-command_t* command_new() {
-    command_t *command = (command_t*)yas_malloc(sizeof(command_t));
+command_t* command_new(arena_t *arena) {
+    command_t *command = (command_t*)arena_alloc(arena, sizeof(command_t));
     command->flags = 0;
+    command->refs = 1;
     command->argc = 0;
+    command->alloc = 0;
     command->argv = 0;
     command->in = 0;
     command->out = 0;
+    command->pipe_size = 0;
+    command->text = 0;
+    command->arena = arena;
+    command->program = 0;
     return command;
 }
 
@@ -86,63 +125,81 @@ command_t* command_new() {
     \brief Add an argument_t to a command_t
 */
 void command_add_argument(command_t *command, argument_t *argument) {
-    command->argv = (argument_t**)yas_realloc(command->argv,
-                                              (command->argc + 1) * sizeof(argument_t*));
+    if (command->argc == command->alloc) {
+        size_t alloc = command->alloc ? 2 * command->alloc : 4;
+        command->argv = (argument_t**)arena_realloc(command->arena,
+                                                    command->argv,
+                                                    command->alloc * sizeof(argument_t*),
+                                                    alloc * sizeof(argument_t*));
+        command->alloc = alloc;
+    }
     command->argv[command->argc] = argument;
     ++command->argc;
 }
 
 /*!
     \internal
-    \brief Add a command_t to a command_t
+    \brief Create a new argument_t
 */
-command_t* command_add_subcommand(command_t *command, command_t *subcommand) {
+argument_t* argument_new(arena_t *arena) {
+    argument_t *argument = (argument_t*)arena_alloc(arena, sizeof(argument_t));
+    argument->type = ARGTYPE_INVALID;
+    argument->n = 0;
+    argument->alloc = 0;
+    argument->d.str = 0;
+    return argument;
+}
+
+/*!
+    \internal
+    \brief Add a command_t to a pipechain or a list
+    \param command Pipechain or list, a single command to turn into one, or 0
+    \param subcommand Command to add
+    \param kind COMMAND_IS_PIPECHAIN or COMMAND_IS_LIST
+*/
+command_t* command_add_subcommand(command_t *command, command_t *subcommand, int kind) {
     if (!command)
         return subcommand;
-    if (!(command->flags & COMMAND_IS_PIPECHAIN)) {
+    if (!(command->flags & kind)) {
         command_t *prev = command;
-        command = command_new();
-        command->flags = COMMAND_IS_PIPECHAIN;
-        command_add_subcommand(command, prev);
+        command = command_new(prev->arena);
+        command->flags = kind;
+        command_add_subcommand(command, prev, kind);
     }
-    argument_t *argument = (argument_t*)yas_malloc(sizeof(argument_t));
+    argument_t *argument = argument_new(command->arena);
     argument->type = ARGTYPE_COMMAND;
     argument->d.cmd = subcommand;
     command_add_argument(command, argument);
     return command;
 }
 
-/*!
-    \internal
-    \brief Create a new argument_t
-*/
-argument_t* argument_new() {
-    argument_t *argument = (argument_t*)yas_malloc(sizeof(argument_t));
-    argument->type = ARGTYPE_INVALID;
-    argument->n = 0;
-    argument->d.str = 0;
-    return argument;
-}
-
 /*!
     \internal
     \brief Add an argument_t to an argument_t
 */
-argument_t* argument_add_sub(argument_t *parent, argument_t *child) {
+argument_t* argument_add_sub(arena_t *arena, argument_t *parent, argument_t *child) {
     if (!parent)
         return child;
     if ((parent->type & ARGTYPE_TYPE_MASK) != ARGTYPE_CAT) {
         argument_t *tmp = parent;
-        parent = argument_new();
+        parent = argument_new(arena);
         parent->type = ARGTYPE_CAT | (tmp->type & ARGTYPE_FLAGS_MASK);
         parent->n = 1;
-        parent->d.sub = (argument_t**)yas_malloc(2 * sizeof(argument_t*));
+        parent->alloc = 4;
+        parent->d.sub = (argument_t**)arena_alloc(arena, parent->alloc * sizeof(argument_t*));
         parent->d.sub[0] = tmp;
         parent->d.sub[1] = 0;
     }
+    /* keep room for the terminating null pointer */
+    if (parent->n + 1 == parent->alloc) {
+        size_t alloc = 2 * parent->alloc;
+        parent->d.sub = (argument_t**)arena_realloc(arena,
+                                                    parent->d.sub,
+                                                    parent->alloc * sizeof(argument_t*),
+                                                    alloc * sizeof(argument_t*));
+        parent->alloc = alloc;
+    }
     ++parent->n;
-    parent->d.sub = (argument_t**)yas_realloc(parent->d.sub,
-                                              (parent->n + 1) * sizeof(argument_t*));
     parent->d.sub[parent->n - 1] = child;
     parent->d.sub[parent->n] = 0;
     return parent;
@@ -152,21 +209,33 @@ argument_t* argument_add_sub(argument_t *parent, argument_t *child) {
     \internal
     \brief Create a new argument_t from a string and add it to another argument_t
 */
-argument_t* argument_add_sub_from_string(argument_t *parent, string_t *s, int quoted) {
+argument_t* argument_add_sub_from_string(arena_t *arena, argument_t *parent, string_t *s, int quoted) {
     if (string_get_length(s)) {
-        argument_t *arg = argument_new();
-        arg->d.str = string_get_cstr_copy(s);
+        argument_t *arg = argument_new(arena);
+        arg->d.str = arena_strndup(arena, string_get_cstr(s), string_get_length(s));
         arg->type = ARGTYPE_STRING;
         if (quoted)
             arg->type |= ARGTYPE_QUOTED;
         string_clear(s);
-        parent = argument_add_sub(parent, arg);
+        parent = argument_add_sub(arena, parent, arg);
     }
     return parent;
 }
 
 /******************************************************************************/
 
+/*!
+    \internal
+    \brief A here-document whose body is yet to be parsed
+*/
+typedef struct {
+    command_t *command;
+    const char *delimiter;
+    size_t length;
+    int strip_tabs;
+    int quoted;
+} heredoc_t;
+
 /*!
     \internal
     \brief Parser context
@@ -177,6 +246,11 @@ typedef struct {
     size_t position;
     int error;
     int substitution;
+    arena_t *arena;
+    string_t *buffer;
+    heredoc_t *heredocs;
+    size_t nheredocs;
+    size_t aheredocs;
 } parse_context_t;
 
 /*!
@@ -190,9 +264,10 @@ int parser_at_end(parse_context_t *cxt) {
 /*!
     \internal
     \brief Get character at current parser position
+    \note Input data need not be zero-terminated : 0 is returned at the end
 */
 char parser_char(parse_context_t *cxt) {
-    return cxt->data[cxt->position];
+    return cxt->position < cxt->length ? cxt->data[cxt->position] : 0;
 }
 
 /*!
@@ -211,7 +286,18 @@ void parser_advance(parse_context_t *cxt, int n) {
     \brief Get character at current parser position and advance current position
 */
 char parser_consume(parse_context_t *cxt) {
-    return cxt->data[cxt->position++];
+    return cxt->position < cxt->length ? cxt->data[cxt->position++] : 0;
+}
+
+/*!
+    \internal
+    \return whether the parser is at a process substitution, "<(" or ">("
+*/
+int parser_at_process(parse_context_t *cxt) {
+    char c = parser_char(cxt);
+    return (c == '<' || c == '>')
+        && cxt->position + 1 < cxt->length
+        && cxt->data[cxt->position + 1] == '(';
 }
 
 /*!
@@ -219,13 +305,91 @@ char parser_consume(parse_context_t *cxt) {
     \brief Skip any whitespaces from current parser position
 */
 void parser_skip_ws(parse_context_t *cxt) {
-    while (cxt->position < cxt->length && isspace(cxt->data[cxt->position]))
+    while (cxt->position < cxt->length && isspace((unsigned char)cxt->data[cxt->position]))
         ++cxt->position;
 }
 
+/*!
+    \internal
+    \brief Character classes used by the lexer
+*/
+enum parser_char_class {
+    PARSER_SPECIAL = 1,
+    PARSER_SPECIAL_QUOTED = 2
+};
+
+#define S PARSER_SPECIAL
+#define Q (PARSER_SPECIAL | PARSER_SPECIAL_QUOTED)
+
+/*!
+    \internal
+    \brief Classes of the characters that interrupt a run of plain characters
+    PARSER_SPECIAL outside double quotes, PARSER_SPECIAL_QUOTED inside.
+*/
+static const unsigned char _parser_class[256] = {
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+    S, S, S, S, S, S, S, S, S, S, S, S, S, S, S, S,
+    [' '] = S, ['#'] = S, ['&'] = S, [')'] = S, ['<'] = S, ['>'] = S,
+    [';'] = S, ['`'] = S, ['|'] = S,
+    ['"'] = Q, ['$'] = Q, ['\\'] = Q
+};
+
+#undef S
+#undef Q
+
+/*!
+    \internal
+    \brief Find the end of a run of plain characters
+    \param cxt Parser context
+    \param from Position from which to scan
+    \param quoted Whether the run is enclosed in double quotes
+    \return position of the first special character at or after \a from
+*/
+size_t parser_scan_plain(parse_context_t *cxt, size_t from, int quoted) {
+    const unsigned char *d = (const unsigned char*)cxt->data;
+    const size_t n = cxt->length;
+    const int mask = quoted ? PARSER_SPECIAL_QUOTED : PARSER_SPECIAL;
+    size_t i = from;
+#ifdef YAS_PARSER_SSE2
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i dquote = _mm_set1_epi8('"');
+    const __m128i dollar = _mm_set1_epi8('$');
+    const __m128i space = _mm_set1_epi8(' ');
+    while (i + 16 <= n) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(d + i));
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, backslash),
+                                              _mm_cmpeq_epi8(v, dquote)),
+                                 _mm_cmpeq_epi8(v, dollar));
+        if (!quoted) {
+            /* control characters and space : unsigned v <= ' ' */
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, space), v));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('#')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('&'))));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(')')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('<'))));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('>')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('`'))));
+            m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('|')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8(';'))));
+        }
+        int bits = _mm_movemask_epi8(m);
+        if (bits)
+            return i + __builtin_ctz(bits);
+        i += 16;
+    }
+#endif
+    while (i < n && !(_parser_class[d[i]] & mask))
+        ++i;
+    return i;
+}
+
 command_t* parse_command_line(parse_context_t *cxt);
+command_t* parse_pipeline(parse_context_t *cxt);
 command_t* parse_command(parse_context_t *cxt);
+int parse_pipe_size(parse_context_t *cxt, command_t *cmd);
 argument_t* parse_argument(parse_context_t *cxt);
+argument_t* parse_expansion(parse_context_t *cxt, int quoted);
+argument_t* parse_arithmetic(parse_context_t *cxt, int quoted);
 
 /* #define YAS_DEBUG_PARSE */
 
@@ -235,27 +399,378 @@ argument_t* parse_argument(parse_context_t *cxt);
 #define dprintf(fmt, ...)
 #endif
 
+/*!
+    \internal
+    \return whether the parser is at a two-character operator made of \a c
+*/
+int parser_at_double(parse_context_t *cxt, char c) {
+    return parser_char(cxt) == c
+        && cxt->position + 1 < cxt->length
+        && cxt->data[cxt->position + 1] == c;
+}
+
 /*!
     \internal
     \brief Parse a full command line
+    A line made of a single pipeline is returned as is. Otherwise the result
+    is a list whose elements are flagged with the operator that precedes them.
+    An and-or list followed by '&' is put in the background as a whole : it
+    becomes a single element of the line, itself a list.
 */
 command_t* parse_command_line(parse_context_t *cxt) {
     dprintf("parse_command_line : %i/%i\n", cxt->position, cxt->length);
     command_t *p = 0;
-    while (!parser_at_end(cxt)) {
-        command_t *cmd = parse_command(cxt);
-        if (!cmd)
+    int op = 0;
+    /* index in p of the first pipeline of the current and-or list */
+    size_t first = 0, start = 0;
+    while (!cxt->error) {
+        parser_skip_ws(cxt);
+        char c = parser_char(cxt);
+        if (parser_at_end(cxt) || c == ')' || (c == '`' && cxt->substitution)) {
+            /* "a ;" and "a &" are complete, "a &&" is not */
+            if (op)
+                cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
             break;
-        p = command_add_subcommand(p, cmd);
+        }
+        if (!op) {
+            first = !p ? 0 : p->flags & COMMAND_IS_LIST ? p->argc : 1;
+            start = cxt->position;
+        }
+        command_t *cmd = parse_pipeline(cxt);
+        if (!cmd) {
+            if (!cxt->error)
+                cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
+            break;
+        }
+        cmd->flags |= op;
+        p = command_add_subcommand(p, cmd, COMMAND_IS_LIST);
+        op = 0;
+        if (parser_at_double(cxt, '&')) {
+            op = COMMAND_AND;
+            parser_advance(cxt, 2);
+        } else if (parser_at_double(cxt, '|')) {
+            op = COMMAND_OR;
+            parser_advance(cxt, 2);
+        } else if (parser_char(cxt) == '&') {
+            size_t end = cxt->position;
+            while (end > start && isspace((unsigned char)cxt->data[end - 1]))
+                --end;
+            if (p != cmd && p->argc - first > 1) {
+                /* move the and-or list into an element of its own */
+                command_t *element = command_new(cxt->arena);
+                element->flags = COMMAND_IS_LIST;
+                size_t i;
+                for (i = first; i < p->argc; ++i)
+                    command_add_argument(element, p->argv[i]);
+                p->argc = first;
+                p = command_add_subcommand(p, element, COMMAND_IS_LIST);
+                cmd = element;
+            }
+            cmd->flags |= COMMAND_IS_BACKGROUND;
+            cmd->text = arena_strndup(cxt->arena, cxt->data + start, end - start);
+            parser_advance(cxt, 1);
+        } else if (parser_char(cxt) == ';') {
+            parser_advance(cxt, 1);
+        } else {
+            break;
+        }
     }
-    if (cxt->error && p) {
-        command_destroy(p);
+    /* partial trees are reclaimed along with the arena */
+    if (cxt->error)
         p = 0;
+    dprintf("=> %p\n", p);
+    return p;
+}
+
+/*!
+    \internal
+    \brief Parse a pipeline : commands separated by '|'
+*/
+command_t* parse_pipeline(parse_context_t *cxt) {
+    dprintf("parse_pipeline : %i/%i\n", cxt->position, cxt->length);
+    command_t *p = 0;
+    while (!cxt->error) {
+        command_t *cmd = parse_command(cxt);
+        if (!cmd) {
+            if (p && !cxt->error)
+                cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
+            break;
+        }
+        p = command_add_subcommand(p, cmd, COMMAND_IS_PIPECHAIN);
+        if (parser_char(cxt) != '|' || parser_at_double(cxt, '|'))
+            break;
+        parser_advance(cxt, 1);
+        parse_pipe_size(cxt, cmd);
     }
+    if (cxt->error)
+        p = 0;
     dprintf("=> %p\n", p);
     return p;
 }
 
+/*!
+    \internal
+    \return a quoted string argument, which may be empty
+*/
+argument_t* argument_new_quoted(arena_t *arena, const char *s, size_t n) {
+    argument_t *arg = argument_new(arena);
+    arg->type = ARGTYPE_STRING | ARGTYPE_QUOTED;
+    arg->d.str = arena_strndup(arena, s, n);
+    return arg;
+}
+
+/*!
+    \internal
+    \brief Parse a here-string or the delimiter of a here-document
+    \return 0 on error
+    The position is just after "<<". The content of a here-string is known
+    right away : its word followed by a newline. The body of a here-document
+    is parsed by parse_heredocs once the whole command line has been parsed,
+    until then the input redirection is an empty string.
+*/
+int parse_here(parse_context_t *cxt, command_t *cmd) {
+    parser_advance(cxt, 1);
+    cmd->flags |= COMMAND_IN_DATA;
+    if (parser_char(cxt) == '<') {
+        parser_advance(cxt, 1);
+        argument_t *word = parse_argument(cxt);
+        if (!word) {
+            if (!cxt->error)
+                cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
+            return 0;
+        }
+        cmd->in = argument_add_sub(cxt->arena, word, argument_new_quoted(cxt->arena, "\n", 1));
+        return 1;
+    }
+    int strip_tabs = parser_char(cxt) == '-';
+    if (strip_tabs)
+        parser_advance(cxt, 1);
+    parser_skip_ws(cxt);
+    /* quotes and backslashes are removed from the delimiter */
+    string_t *tmp = cxt->buffer;
+    string_clear(tmp);
+    int quoted = 0, in_quotes = 0;
+    while (!parser_at_end(cxt)) {
+        char c = parser_char(cxt);
+        if (c == '\\') {
+            parser_advance(cxt, 1);
+            if (!parser_at_end(cxt))
+                string_append_char(tmp, parser_consume(cxt));
+            quoted = 1;
+        } else if (c == '"') {
+            parser_advance(cxt, 1);
+            in_quotes = !in_quotes;
+            quoted = 1;
+        } else if (!in_quotes && ((unsigned char)c <= ' ' || strchr("|<>&;)`#", c))) {
+            break;
+        } else {
+            string_append_char(tmp, parser_consume(cxt));
+        }
+    }
+    size_t length = string_get_length(tmp);
+    if (in_quotes || !length || length >= sizeof(((command_error_t*)0)->delimiter)) {
+        cxt->error = in_quotes ? ERRTYPE_UNMATCHING_DELIMITERS : ERRTYPE_UNKNOWN_SYNTAX;
+        return 0;
+    }
+    parser_skip_ws(cxt);
+    if (cxt->nheredocs == cxt->aheredocs) {
+        size_t alloc = cxt->aheredocs ? 2 * cxt->aheredocs : 4;
+        cxt->heredocs = (heredoc_t*)arena_realloc(cxt->arena,
+                                                  cxt->heredocs,
+                                                  cxt->aheredocs * sizeof(heredoc_t),
+                                                  alloc * sizeof(heredoc_t));
+        cxt->aheredocs = alloc;
+    }
+    heredoc_t *h = cxt->heredocs + cxt->nheredocs++;
+    h->command = cmd;
+    h->delimiter = arena_strndup(cxt->arena, string_get_cstr(tmp), length);
+    h->length = length;
+    h->strip_tabs = strip_tabs;
+    h->quoted = quoted;
+    cmd->in = argument_new_quoted(cxt->arena, "", 0);
+    return 1;
+}
+
+/*!
+    \internal
+    \return whether a line ends a here-document
+*/
+int heredoc_line_ends(const char *delimiter, size_t length, int strip_tabs, const char *line, size_t sz) {
+    if (strip_tabs)
+        while (sz && *line == '\t') {
+            ++line;
+            --sz;
+        }
+    return sz == length && !memcmp(line, delimiter, length);
+}
+
+/*!
+    \internal
+    \brief Parse the text of a here-document body
+    Only '$' and '\\' are special : the text is expanded like a quoted string
+    that may span several lines. A backslash only escapes '$', '`', '\\' and
+    newlines.
+*/
+argument_t* parse_heredoc_text(parse_context_t *cxt, const char *text, size_t n) {
+    const char *data = cxt->data;
+    size_t length = cxt->length, position = cxt->position;
+    cxt->data = text;
+    cxt->length = n;
+    cxt->position = 0;
+    string_t *tmp = cxt->buffer;
+    string_clear(tmp);
+    argument_t *p = 0;
+    while (!cxt->error && !parser_at_end(cxt)) {
+        char c = parser_char(cxt);
+        if (c == '\\') {
+            char next = cxt->position + 1 < n ? text[cxt->position + 1] : 0;
+            if (next == '$' || next == '`' || next == '\\')
+                string_append_char(tmp, next);
+            else if (next != '\n')
+                string_append_char(tmp, c);
+            parser_advance(cxt, next == '$' || next == '`' || next == '\\' || next == '\n' ? 2 : 1);
+        } else if (c == '$') {
+            p = argument_add_sub_from_string(cxt->arena, p, tmp, 1);
+            argument_t *arg = parse_expansion(cxt, 1);
+            if (!arg)
+                break;
+            p = argument_add_sub(cxt->arena, p, arg);
+        } else {
+            size_t end = cxt->position + 1;
+            while (end < n && text[end] != '$' && text[end] != '\\')
+                ++end;
+            string_append_cstrn(tmp, text + cxt->position, end - cxt->position);
+            cxt->position = end;
+        }
+    }
+    p = argument_add_sub_from_string(cxt->arena, p, tmp, 1);
+    cxt->data = data;
+    cxt->length = length;
+    cxt->position = position;
+    return p ? p : argument_new_quoted(cxt->arena, "", 0);
+}
+
+/*!
+    \internal
+    \brief Parse the bodies of the here-documents of a command line
+    \return 0 on error
+    Bodies follow the command line, in the order of the here-documents. A
+    missing delimiter is reported as ERRTYPE_INCOMPLETE_HEREDOC, with the
+    position at the end of the input : the caller may retry once more lines
+    are available.
+*/
+int parse_heredocs(parse_context_t *cxt, command_error_t *error) {
+    size_t i, n = cxt->nheredocs;
+    for (i = 0; i < n; ++i) {
+        heredoc_t *h = cxt->heredocs + i;
+        const char *body = cxt->data + cxt->position;
+        size_t pos = cxt->position, end = pos;
+        int found = 0;
+        while (pos < cxt->length) {
+            const char *nl = (const char*)memchr(cxt->data + pos, '\n', cxt->length - pos);
+            size_t eol = nl ? (size_t)(nl - cxt->data) : cxt->length;
+            if (heredoc_line_ends(h->delimiter, h->length, h->strip_tabs, cxt->data + pos, eol - pos)) {
+                found = 1;
+                end = pos;
+                pos = nl ? eol + 1 : eol;
+                break;
+            }
+            pos = nl ? eol + 1 : eol;
+        }
+        if (!found) {
+            cxt->error = ERRTYPE_INCOMPLETE_HEREDOC;
+            cxt->position = cxt->length;
+            if (error) {
+                memcpy(error->delimiter, h->delimiter, h->length + 1);
+                error->strip_tabs = h->strip_tabs;
+            }
+            return 0;
+        }
+        size_t sz = end - cxt->position;
+        if (h->strip_tabs) {
+            /* work on a copy of the body without leading tabs */
+            char *copy = (char*)arena_alloc(cxt->arena, sz + 1);
+            size_t j = 0, k = 0;
+            int bol = 1;
+            for (; j < sz; ++j) {
+                if (bol && body[j] == '\t')
+                    continue;
+                bol = body[j] == '\n';
+                copy[k++] = body[j];
+            }
+            body = copy;
+            sz = k;
+        }
+        cxt->position = pos;
+        h->command->in = h->quoted
+                ? argument_new_quoted(cxt->arena, body, sz)
+                : parse_heredoc_text(cxt, body, sz);
+        if (cxt->error || cxt->nheredocs != n) {
+            /* here-documents are not allowed within the body of another one */
+            if (!cxt->error)
+                cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*!
+    \internal
+    \brief Parse an input or output redirection of a command
+    \return 0 on error
+*/
+int parse_redirection(parse_context_t *cxt, command_t *cmd) {
+    char c = parser_char(cxt);
+    argument_t **target = c == '<' ? &cmd->in : &cmd->out;
+    if (!*target) {
+        parser_advance(cxt, 1);
+        if (c == '<' && parser_char(cxt) == '<')
+            return parse_here(cxt, cmd);
+        *target = parse_argument(cxt);
+        if (*target)
+            return 1;
+    }
+    cxt->error = c == '<' ? ERRTYPE_DUPLICATED_INPUT : ERRTYPE_DUPLICATED_OUTPUT;
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Parse the optional buffer size of a pipe, e.g. "|{1M}"
+    \return 0 on error
+*/
+int parse_pipe_size(parse_context_t *cxt, command_t *cmd) {
+    if (parser_char(cxt) != '{')
+        return 1;
+    parser_advance(cxt, 1);
+    size_t size = 0;
+    char c = parser_char(cxt);
+    if (!isdigit((unsigned char)c)) {
+        cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
+        return 0;
+    }
+    while (isdigit((unsigned char)c)) {
+        /* saturate : sizes are capped at pipe-max-size anyway */
+        if (size < ((size_t)1 << 40))
+            size = size * 10 + (c - '0');
+        parser_advance(cxt, 1);
+        c = parser_char(cxt);
+    }
+    if (c == 'k' || c == 'K' || c == 'm' || c == 'M') {
+        size <<= (c == 'k' || c == 'K') ? 10 : 20;
+        parser_advance(cxt, 1);
+        c = parser_char(cxt);
+    }
+    if (c != '}') {
+        cxt->error = ERRTYPE_UNMATCHING_DELIMITERS;
+        return 0;
+    }
+    parser_advance(cxt, 1);
+    cmd->pipe_size = size;
+    return 1;
+}
+
 /*!
     \internal
     \brief Parse a single command
@@ -263,40 +778,32 @@ command_t* parse_command_line(parse_context_t *cxt) {
 command_t* parse_command(parse_context_t *cxt) {
     dprintf("parse_command : %i/%i\n", cxt->position, cxt->length);
     command_t *cmd = 0;
-    while (!parser_at_end(cxt)) {
+    /* leading redirections, e.g. "< file cmd" or "$(< file)" */
+    parser_skip_ws(cxt);
+    while ((parser_char(cxt) == '<' || parser_char(cxt) == '>') && !parser_at_process(cxt)) {
+        if (!cmd)
+            cmd = command_new(cxt->arena);
+        if (!parse_redirection(cxt, cmd))
+            break;
+    }
+    while (!cxt->error && !parser_at_end(cxt)) {
         argument_t *arg = parse_argument(cxt);
         if (!arg)
             break;
         else if (!cmd)
-            cmd = command_new();
+            cmd = command_new(cxt->arena);
         command_add_argument(cmd, arg);
         int long_break = 1;
         while (1) {
             char c = parser_char(cxt);
-            if (c == '|' || c == '&') {
-                parser_advance(cxt, 1);
-                if (c == '&')
-                    cmd->flags |= COMMAND_IS_BACKGROUND;
+            if (c == '|' || c == '&' || c == ';') {
+                /* operators are handled by the callers */
                 break;
             } else if (c == ')' || (c == '`' && cxt->substitution)) {
                 break;
-            } else if (c == '<') {
-                if (!cmd->in) {
-                    parser_advance(cxt, 1);
-                    cmd->in = parse_argument(cxt);
-                    if (cmd->in)
-                        continue;
-                }
-                cxt->error = ERRTYPE_DUPLICATED_INPUT;
-                break;
-            } else if (c == '>') {
-                if (!cmd->out) {
-                    parser_advance(cxt, 1);
-                    cmd->out = parse_argument(cxt);
-                    if (cmd->out)
-                        continue;
-                }
-                cxt->error = ERRTYPE_DUPLICATED_OUTPUT;
+            } else if ((c == '<' || c == '>') && !parser_at_process(cxt)) {
+                if (parse_redirection(cxt, cmd))
+                    continue;
                 break;
             }
             long_break = 0;
@@ -305,10 +812,8 @@ command_t* parse_command(parse_context_t *cxt) {
         if (long_break)
             break;
     }
-    if (cxt->error && cmd) {
-        command_destroy(cmd);
+    if (cxt->error)
         cmd = 0;
-    }
     dprintf("=> %p\n", cmd);
     return cmd;
 }
@@ -319,162 +824,285 @@ command_t* parse_command(parse_context_t *cxt) {
 */
 argument_t* parse_argument(parse_context_t *cxt) {
     dprintf("parse_argument : %i/%i\n", cxt->position, cxt->length);
-    string_t *tmp = string_new();
+    string_t *tmp = cxt->buffer;
     argument_t *p = 0;
+    string_clear(tmp);
     parser_skip_ws(cxt);
     int quoted = 0;
     while (!parser_at_end(cxt)) {
         char c = parser_char(cxt);
         if (c == '\\') {
             parser_advance(cxt, 1);
-            string_append_char(tmp, parser_consume(cxt));
+            if (!parser_at_end(cxt))
+                string_append_char(tmp, parser_consume(cxt));
         } else if (c == '\"') {
-            p = argument_add_sub_from_string(p, tmp, quoted);
+            p = argument_add_sub_from_string(cxt->arena, p, tmp, quoted);
             quoted = !quoted;
             parser_advance(cxt, 1);
-        } else if (c == '$' || (c == '`' && !quoted && !cxt->substitution)) {
-            p = argument_add_sub_from_string(p, tmp, quoted);
-            int is_sub = c == '`';
-            if (!is_sub) {
-                parser_advance(cxt, 1);
-                c = parser_char(cxt);
-                is_sub = c == '(';
-            } else {
-                cxt->substitution = 1;
-            }
-            if (is_sub) {
-                parser_advance(cxt, 1);
-                command_t *sub = parse_command_line(cxt);
-                if (!sub) {
-                    break;
-                }
-                argument_t *arg = argument_new();
-                arg->type = ARGTYPE_COMMAND;
-                arg->d.cmd = sub;
-                if (quoted)
-                    arg->type |= ARGTYPE_QUOTED;
-                p = argument_add_sub(p, arg);
-                char pc = parser_char(cxt);
-                if ((c == '(' && pc == ')') || (c == '`' && pc == '`')) {
-                    parser_advance(cxt, 1);
-                    if (c == '`')
-                        cxt->substitution = 0;
-                } else {
-                    cxt->error = ERRTYPE_UNMATCHING_DELIMITERS;
-                }
-            } else if (isalnum(c) || (c == '_')) {
-                while (!parser_at_end(cxt) && (isalnum(c) || (c == '_'))) {
-                    string_append_char(tmp, c);
-                    parser_advance(cxt, 1);
-                    c = parser_char(cxt);
-                }
-                argument_t *arg = argument_new();
-                arg->type = ARGTYPE_VARIABLE;
-                arg->d.str = string_get_cstr_copy(tmp);
-                string_clear(tmp);
-                if (quoted)
-                    arg->type |= ARGTYPE_QUOTED;
-                p = argument_add_sub(p, arg);
-            } else {
-                /* TODO: report a deeper analysis of the error */
-                cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
-            }
-        } else if (!quoted && (c <= ' ' || c == '|' || c == '<' || c == '>' || c == '&' || c == ')' || c == '`')) {
+        } else if (c == '$' || (c == '`' && !quoted && !cxt->substitution)
+                   || (!quoted && parser_at_process(cxt))) {
+            p = argument_add_sub_from_string(cxt->arena, p, tmp, quoted);
+            argument_t *arg = parse_expansion(cxt, quoted);
+            if (!arg)
+                break;
+            p = argument_add_sub(cxt->arena, p, arg);
+        } else if (!quoted && ((unsigned char)c <= ' ' || c == '|' || c == '<' || c == '>' || c == '&' || c == ';' || c == ')' || c == '`')) {
             parser_skip_ws(cxt);
             break;
         } else if (!quoted && c == '#') {
             cxt->position = cxt->length;
             break;
         } else {
-            string_append_char(tmp, parser_consume(cxt));
+            /* current character is plain : append the whole run at once */
+            size_t end = parser_scan_plain(cxt, cxt->position + 1, quoted);
+            string_append_cstrn(tmp, cxt->data + cxt->position, end - cxt->position);
+            cxt->position = end;
         }
     }
-    if (cxt->error && p) {
-        argument_destroy(p);
+    if (cxt->error)
         p = 0;
-    } else {
-        p = argument_add_sub_from_string(p, tmp, quoted);
-    }
-    string_destroy(tmp);
+    else
+        p = argument_add_sub_from_string(cxt->arena, p, tmp, quoted);
     dprintf("=> %p\n", p);
     return p;
 }
 
-/******************************************************************************/
+/*!
+    \internal
+    \brief Parse a variable, a command substitution or a process substitution
+    \param cxt Parser context, at the '$', '`', '<' or '>' character
+    \param quoted Whether the expansion is enclosed in double quotes
+    \return the parsed argument, 0 on error
+*/
+argument_t* parse_expansion(parse_context_t *cxt, int quoted) {
+    char c = parser_char(cxt);
+    int is_sub = c == '`';
+    int type = ARGTYPE_COMMAND;
+    if (c == '<' || c == '>') {
+        parser_advance(cxt, 1);
+        type = c == '<' ? ARGTYPE_PROCESS_IN : ARGTYPE_PROCESS_OUT;
+        c = parser_char(cxt);
+        is_sub = 1;
+    } else if (!is_sub) {
+        parser_advance(cxt, 1);
+        c = parser_char(cxt);
+        is_sub = c == '(';
+    } else {
+        cxt->substitution = 1;
+    }
+    argument_t *arg = 0;
+    if (c == '(' && type == ARGTYPE_COMMAND
+            && cxt->position + 1 < cxt->length && cxt->data[cxt->position + 1] == '(') {
+        return parse_arithmetic(cxt, quoted);
+    } else if (is_sub) {
+        parser_advance(cxt, 1);
+        command_t *sub = parse_command_line(cxt);
+        if (!sub)
+            return 0;
+        arg = argument_new(cxt->arena);
+        arg->type = type;
+        arg->d.cmd = sub;
+        char pc = parser_char(cxt);
+        if ((c == '(' && pc == ')') || (c == '`' && pc == '`')) {
+            parser_advance(cxt, 1);
+            if (c == '`')
+                cxt->substitution = 0;
+        } else {
+            cxt->error = ERRTYPE_UNMATCHING_DELIMITERS;
+            return 0;
+        }
+    } else if (c == '?' || c == '!' || c == '$') {
+        /* special variables */
+        parser_advance(cxt, 1);
+        arg = argument_new(cxt->arena);
+        arg->type = ARGTYPE_VARIABLE;
+        arg->d.str = arena_strndup(cxt->arena, cxt->data + cxt->position - 1, 1);
+    } else if (isalnum((unsigned char)c) || (c == '_')) {
+        size_t start = cxt->position;
+        while (!parser_at_end(cxt) && (isalnum((unsigned char)c) || (c == '_'))) {
+            parser_advance(cxt, 1);
+            c = parser_char(cxt);
+        }
+        arg = argument_new(cxt->arena);
+        arg->type = ARGTYPE_VARIABLE;
+        arg->d.str = arena_strndup(cxt->arena,
+                                   cxt->data + start,
+                                   cxt->position - start);
+    } else {
+        /* TODO: report a deeper analysis of the error */
+        cxt->error = ERRTYPE_UNKNOWN_SYNTAX;
+        return 0;
+    }
+    if (quoted)
+        arg->type |= ARGTYPE_QUOTED;
+    return arg;
+}
 
-static size_t _command_error_position = 0;
-static string_t *_command_error_string = 0;
+/*!
+    \internal
+    \brief Parse an arithmetic expansion
+    \param cxt Parser context, at the "((" following the '$'
+    \param quoted Whether the expansion is enclosed in double quotes
+    \return the parsed argument, 0 on error
+    The expression extends to the "))" that balances the parentheses. Its
+    syntax is checked here but it is only evaluated when the command runs.
+*/
+argument_t* parse_arithmetic(parse_context_t *cxt, int quoted) {
+    parser_advance(cxt, 2);
+    size_t start = cxt->position;
+    size_t depth = 0;
+    while (!parser_at_end(cxt)) {
+        char c = parser_char(cxt);
+        if (c == ')' && !depth)
+            break;
+        if (c == '(')
+            ++depth;
+        else if (c == ')')
+            --depth;
+        parser_advance(cxt, 1);
+    }
+    size_t end = cxt->position;
+    if (parser_at_end(cxt) || end + 1 >= cxt->length || cxt->data[end + 1] != ')') {
+        cxt->error = ERRTYPE_UNMATCHING_DELIMITERS;
+        return 0;
+    }
+    parser_advance(cxt, 2);
+    argument_t *arg = argument_new(cxt->arena);
+    arg->type = ARGTYPE_ARITH;
+    arg->d.str = arena_strndup(cxt->arena, cxt->data + start, end - start);
+    if (arith_check(arg->d.str, 0)) {
+        cxt->position = start;
+        cxt->error = ERRTYPE_ARITHMETIC;
+        return 0;
+    }
+    if (quoted)
+        arg->type |= ARGTYPE_QUOTED;
+    return arg;
+}
+
+/******************************************************************************/
 
 /*!
     \brief Parse a textual representation of a command line into a command_t
     \param str input data
     \param sz size of input data
+    \param error parse error description, filled on failure (may be 0)
     \return parsed representation of command line, 0 on parse error
+    No global state is involved : command_create may be called concurrently
+    from several threads.
 */
-command_t* command_create(const char *str, size_t sz) {
-    _command_error_position = (size_t)-1;
-    if (_command_error_string)
-        string_clear(_command_error_string);
-    else
-        _command_error_string = string_new();
+command_t* command_create(const char *str, size_t sz, command_error_t *error) {
     parse_context_t cxt;
     cxt.data = str;
     cxt.length = sz;
     cxt.position = 0;
-    cxt.error = 0;
+    cxt.error = ERRTYPE_NONE;
     cxt.substitution = 0;
+    cxt.arena = arena_new();
+    cxt.buffer = string_new();
+    cxt.heredocs = 0;
+    cxt.nheredocs = 0;
+    cxt.aheredocs = 0;
+    /* the command line ends at the first newline, here-document bodies follow */
+    const char *nl = (const char*)memchr(str, '\n', sz);
+    if (nl)
+        cxt.length = nl - str;
     command_t* cmd = parse_command_line(&cxt);
-    if (cxt.error) {
-        _command_error_position = cxt.position;
-        switch (cxt.error) {
-            case ERRTYPE_DUPLICATED_INPUT:
-                string_append_cstr(_command_error_string, "Duplicated input");
-                break;
-            case ERRTYPE_DUPLICATED_OUTPUT:
-                string_append_cstr(_command_error_string, "Duplicated output");
-                break;
-            case ERRTYPE_UNMATCHING_DELIMITERS:
-                string_append_cstr(_command_error_string, "Unmatching delimiters");
-                break;
-            default:
-                string_append_cstr(_command_error_string, "Unknown");
-                break;
-        }
-    } else if (cxt.position < cxt.length) {
-        _command_error_position = cxt.position;
-        string_append_cstr(_command_error_string, "Input left : ");
-        string_append_cstr(_command_error_string, cxt.data + cxt.position);
-        command_destroy(cmd);
+    if (!cxt.error && cxt.position < cxt.length) {
+        cxt.error = ERRTYPE_INPUT_LEFT;
         cmd = 0;
     }
+    if (!cxt.error && (cxt.nheredocs || nl)) {
+        cxt.position = nl ? cxt.length + 1 : sz;
+        cxt.length = sz;
+        if (!parse_heredocs(&cxt, error) || cxt.position < cxt.length) {
+            if (!cxt.error)
+                cxt.error = ERRTYPE_INPUT_LEFT;
+            cmd = 0;
+        }
+    }
+    string_destroy(cxt.buffer);
+    if (error) {
+        error->type = cxt.error;
+        error->position = cxt.error ? cxt.position : (size_t)-1;
+    }
+    if (cmd) {
+        /* the root command owns the memory of the whole tree */
+        cmd->flags |= COMMAND_OWNS_ARENA;
+    } else {
+        arena_destroy(cxt.arena);
+    }
     return cmd;
 }
 
 /*!
-    \return the position of the last error encountered by command_create, if any
+    \return a human readable description of a parse error
 */
-size_t command_error_position() {
-    return _command_error_position;
+const char* command_error_string(const command_error_t *error) {
+    switch (error->type) {
+        case ERRTYPE_NONE:
+            return "No error";
+        case ERRTYPE_DUPLICATED_INPUT:
+            return "Duplicated input";
+        case ERRTYPE_DUPLICATED_OUTPUT:
+            return "Duplicated output";
+        case ERRTYPE_UNMATCHING_DELIMITERS:
+            return "Unmatching delimiters";
+        case ERRTYPE_INPUT_LEFT:
+            return "Input left";
+        case ERRTYPE_INCOMPLETE_HEREDOC:
+            return "Unterminated here-document";
+        case ERRTYPE_ARITHMETIC:
+            return "Invalid arithmetic expression";
+        default:
+            break;
+    }
+    return "Unknown";
 }
 
 /*!
-    \return the error string of the last error encountered by command_create, if any
+    \brief Acquire a reference to a command_t
+    \return \a command
+    Parsed commands are never modified after command_create returns, which
+    allows a single tree to be shared read-only. Each reference must be
+    released with command_destroy.
 */
-const char* command_error_string() {
-    return string_get_cstr(_command_error_string);
+command_t* command_ref(command_t *command) {
+    if (command && (command->flags & COMMAND_OWNS_ARENA))
+        ++command->refs;
+    return command;
 }
 
 /*!
-    \brief Destroy a command_t
+    \brief Release a reference to a command_t, destroying it with the last one
+    Only commands returned by command_create can be destroyed : the memory of
+    nested commands and arguments is released along with their root.
 */
 void command_destroy(command_t *command) {
-    if (!command)
+    if (!command || !(command->flags & COMMAND_OWNS_ARENA))
         return;
-    size_t i;
-    for (i = 0; i < command->argc; ++i)
-        argument_destroy(command->argv[i]);
-    yas_free(command->argv);
-    yas_free(command);
+    if (--command->refs)
+        return;
+    program_destroy(command->program);
+    arena_destroy(command->arena);
+}
+
+/*!
+    \return the compiled form of a command_t, if any
+    \see program_compile
+*/
+program_t* command_program(command_t *command) {
+    return command ? command->program : 0;
+}
+
+/*!
+    \brief Attach the compiled form of a command_t
+    The program is destroyed along with the command. It can only be attached
+    to commands returned by command_create.
+*/
+void command_set_program(command_t *command, program_t *program) {
+    if (command && (command->flags & COMMAND_OWNS_ARENA))
+        command->program = program;
 }
 
 /*!
@@ -484,13 +1112,15 @@ void command_inspect(command_t *command, size_t indent) {
     if (!command)
         return;
     indent_printf(indent, "flags = %u\n", command->flags);
+    if (command->pipe_size)
+        indent_printf(indent, "pipe_size = %zu\n", command->pipe_size);
     indent_printf(indent, "args = {\n");
     size_t i;
     for (i = 0; i < command->argc; ++i)
         argument_inspect(command->argv[i], indent + 1);
     
     if (command->in) {
-        indent_printf(indent, "<\n");
+        indent_printf(indent, (command->flags & COMMAND_IN_DATA) ? "<<\n" : "<\n");
         argument_inspect(command->in, indent + 1);
     }
     if (command->out) {
@@ -507,6 +1137,27 @@ argument_t* command_redir_in(command_t *command) {
     return command ? command->in : 0;
 }
 
+/*!
+    \return whether the input redirection is the content of a here-document
+    or here-string, instead of a file name
+*/
+int command_redir_in_is_data(command_t *command) {
+    return command ? command->flags & COMMAND_IN_DATA : 0;
+}
+
+/*!
+    \brief Tell whether a line ends the here-document reported by a parse error
+    \param error Error of type ERRTYPE_INCOMPLETE_HEREDOC
+    \param line Line, without its newline
+    \param sz Size of the line
+    Used to read the lines of a here-document before parsing it again.
+*/
+int command_heredoc_ends(const command_error_t *error, const char *line, size_t sz) {
+    if (!error || error->type != ERRTYPE_INCOMPLETE_HEREDOC)
+        return 0;
+    return heredoc_line_ends(error->delimiter, strlen(error->delimiter), error->strip_tabs, line, sz);
+}
+
 /*!
     \return the argument_t corresponding to output redirection, if any
 */
@@ -537,6 +1188,33 @@ int command_is_pipechain(command_t *command) {
     return command ? command->flags & COMMAND_IS_PIPECHAIN : 0;
 }
 
+/*!
+    \return the requested buffer size of the pipe the command writes into, 0
+    for the default
+*/
+size_t command_pipe_size(command_t *command) {
+    return command ? command->pipe_size : 0;
+}
+
+/*!
+    \return whether the command is a list of pipelines separated by ';', '&',
+    '&&' or '||'
+*/
+int command_is_list(command_t *command) {
+    return command ? command->flags & COMMAND_IS_LIST : 0;
+}
+
+/*!
+    \return the condition under which an element of a list is run
+*/
+int command_list_op(command_t *command) {
+    if (!command)
+        return LIST_SEQ;
+    return command->flags & COMMAND_AND
+            ? LIST_AND
+            : command->flags & COMMAND_OR ? LIST_OR : LIST_SEQ;
+}
+
 /*!
     \return whether the command is supposed to be executed as a background task
 */
@@ -545,21 +1223,10 @@ int command_is_background(command_t *command) {
 }
 
 /*!
-    \brief Destroy an argument_t
+    \return the source text of a background command, 0 if it is not known
 */
-void argument_destroy(argument_t *argument) {
-    int type = argument->type & ARGTYPE_TYPE_MASK;
-    if (type == ARGTYPE_COMMAND) {
-        command_destroy(argument->d.cmd);
-    } else if (type == ARGTYPE_CAT) {
-        argument_t **l = argument->d.sub;
-        while (l && *l)
-            argument_destroy(*(l++));
-        yas_free(argument->d.sub);
-    } else if (type == ARGTYPE_STRING || type == ARGTYPE_VARIABLE) {
-        yas_free(argument->d.str);
-    }
-    yas_free(argument);
+const char* command_text(command_t *command) {
+    return command ? command->text : 0;
 }
 
 /*!
@@ -576,9 +1243,15 @@ void argument_inspect(argument_t *argument, size_t indent) {
                           argument->d.str);
             break;
         case ARGTYPE_COMMAND:
+        case ARGTYPE_PROCESS_IN:
+        case ARGTYPE_PROCESS_OUT:
             indent_printf(indent,
-                          "%cCOMMAND = {\n",
-                          argument->type & ARGTYPE_QUOTED ? '*' : ' ');
+                          "%c%s = {\n",
+                          argument->type & ARGTYPE_QUOTED ? '*' : ' ',
+                          (argument->type & ARGTYPE_TYPE_MASK) == ARGTYPE_COMMAND
+                            ? "COMMAND"
+                            : (argument->type & ARGTYPE_TYPE_MASK) == ARGTYPE_PROCESS_IN
+                                ? "PROCESS_IN" : "PROCESS_OUT");
             command_inspect(argument->d.cmd, indent + 1);
             indent_printf(indent, "}\n");
             break;
@@ -587,6 +1260,11 @@ void argument_inspect(argument_t *argument, size_t indent) {
                           argument->type & ARGTYPE_QUOTED ? '*' : ' ',
                           argument->d.str);
             break;
+        case ARGTYPE_ARITH:
+            indent_printf(indent, "%cARITH = \"%s\"\n",
+                          argument->type & ARGTYPE_QUOTED ? '*' : ' ',
+                          argument->d.str);
+            break;
         case ARGTYPE_CAT:
         {
             indent_printf(indent, "%cCAT = {\n",
@@ -631,11 +1309,23 @@ char* argument_get_variable(argument_t *argument) {
     return argument && (argument->type & ARGTYPE_TYPE_MASK) == ARGTYPE_VARIABLE ? argument->d.str : 0;
 }
 
+/*!
+    \return the expression of an arithmetic expansion
+*/
+char* argument_get_expression(argument_t *argument) {
+    return argument && (argument->type & ARGTYPE_TYPE_MASK) == ARGTYPE_ARITH ? argument->d.str : 0;
+}
+
 /*!
     \return the content of the argument as a command_t
 */
 command_t* argument_get_command(argument_t *argument) {
-    return argument && (argument->type & ARGTYPE_TYPE_MASK) == ARGTYPE_COMMAND ? argument->d.cmd : 0;
+    if (!argument)
+        return 0;
+    int type = argument->type & ARGTYPE_TYPE_MASK;
+    return type == ARGTYPE_COMMAND || type == ARGTYPE_PROCESS_IN || type == ARGTYPE_PROCESS_OUT
+            ? argument->d.cmd
+            : 0;
 }
 
 /*!
@@ -31,21 +31,45 @@ typedef struct _command command_t;
 */
 typedef struct _argument argument_t;
 
-command_t* command_create(const char *str, size_t sz);
+/*!
+    \brief Description of a parse error
+    Filled by command_create. Owned by the caller so that independent command
+    lines can be parsed concurrently.
+*/
+typedef struct _command_error {
+    int type;
+    size_t position;
+    /*! ERRTYPE_INCOMPLETE_HEREDOC : delimiter of the unterminated here-document */
+    char delimiter[64];
+    int strip_tabs;
+} command_error_t;
+
+struct _program;
+
+command_t* command_create(const char *str, size_t sz, command_error_t *error);
+command_t* command_ref(command_t *command);
 void command_destroy(command_t *command);
 void command_inspect(command_t *command, size_t indent);
 
-size_t command_error_position();
-const char* command_error_string();
+struct _program* command_program(command_t *command);
+void command_set_program(command_t *command, struct _program *program);
+
+const char* command_error_string(const command_error_t *error);
+int command_heredoc_ends(const command_error_t *error, const char *line, size_t sz);
 
 int command_argc(command_t *command);
 argument_t** command_argv(command_t *command);
 
 argument_t* command_redir_in(command_t *command);
+int command_redir_in_is_data(command_t *command);
 argument_t* command_redir_out(command_t *command);
 
 int command_is_pipechain(command_t *command);
+int command_is_list(command_t *command);
+int command_list_op(command_t *command);
 int command_is_background(command_t *command);
+const char* command_text(command_t *command);
+size_t command_pipe_size(command_t *command);
 
 enum argument_type {
     ARGTYPE_INVALID,
@@ -53,25 +77,41 @@ enum argument_type {
     ARGTYPE_COMMAND,
     ARGTYPE_VARIABLE,
     ARGTYPE_CAT,
+    ARGTYPE_PROCESS_IN,     /*!< <(command) : path to read the output of command from */
+    ARGTYPE_PROCESS_OUT,    /*!< >(command) : path to write the input of command to */
+    ARGTYPE_ARITH,          /*!< $((expression)) : value of an arithmetic expression */
     ARGTYPE_TYPE_MASK = 0x0FFF,
     ARGTYPE_FLAGS_MASK = 0xF000,
     ARGTYPE_QUOTED = 0x8000
 };
 
+/*!
+    \brief Condition under which an element of a list is run
+*/
+enum list_op {
+    LIST_SEQ,   /*!< always, after ';' or '&' */
+    LIST_AND,   /*!< if the previous element succeeded, after '&&' */
+    LIST_OR     /*!< if the previous element failed, after '||' */
+};
+
 enum error_type {
+    ERRTYPE_NONE,
     ERRTYPE_DUPLICATED_INPUT,
     ERRTYPE_DUPLICATED_OUTPUT,
     ERRTYPE_UNMATCHING_DELIMITERS,
-    ERRTYPE_UNKNOWN_SYNTAX
+    ERRTYPE_UNKNOWN_SYNTAX,
+    ERRTYPE_INPUT_LEFT,
+    ERRTYPE_INCOMPLETE_HEREDOC,
+    ERRTYPE_ARITHMETIC
 };
 
-void argument_destroy(argument_t *argument);
 void argument_inspect(argument_t *argument, size_t indent);
 
 int argument_type(argument_t *argument);
 int argument_flags(argument_t *argument);
 char* argument_get_string(argument_t *argument);
 char* argument_get_variable(argument_t *argument);
+char* argument_get_expression(argument_t *argument);
 command_t* argument_get_command(argument_t *argument);
 argument_t** argument_get_arguments(argument_t *argument);
 
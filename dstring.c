@@ -40,7 +40,10 @@ static void string_realloc(string_t *s, size_t sz) {
 static void string_grow(string_t *s, size_t n) {
     if (s->alloc - s->size > n)
         return;
-    string_realloc(s, s->size ? 2 * s->size : 16);
+    size_t sz = s->size ? 2 * s->size : 16;
+    if (sz <= s->size + n)
+        sz = s->size + n + 1;
+    string_realloc(s, sz);
 }
 
 /*!
@@ -187,7 +190,7 @@ void string_append_cstrn(string_t *dst, const char *str, size_t n) {
     if (!dst || !str || !n)
         return;
     string_grow(dst, n);
-    strncpy(dst->data + dst->size, str, n);
+    memcpy(dst->data + dst->size, str, n);
     dst->size += n;
     dst->data[dst->size] = 0;
 }
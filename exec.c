@@ -11,6 +11,7 @@
 ** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
 *******************************************************************************/
 
+#define _GNU_SOURCE
 #include "exec.h"
 
 /*!
@@ -20,8 +21,15 @@
 
 #include "memory.h"
 #include "command.h"
+#include "program.h"
 #include "dstring.h"
 #include "argv.h"
+#include "options.h"
+#include "path.h"
+#include "var.h"
+#include "arith.h"
+#include "builtin.h"
+#include "input.h"
 #include "util.h"
 
 #include <ctype.h>
@@ -31,261 +39,1677 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
 #include <fcntl.h>
 
+extern char **environ;
+
+/*!
+    \internal
+    \brief State of a block being executed
+*/
+typedef struct {
+    argv_t *argv;
+    string_t *word;
+    char *in;
+    char *out;
+    /* whether in is the content of a here-document instead of a file name */
+    int in_data;
+    /* descriptors of the process substitutions of the command */
+    int *fds;
+    size_t nfds;
+    /* "name=value" assignments preceding the command, 0 if there are none */
+    argv_t *assign;
+    /* exit status of the last command substitution, e.g. that of "x=$(cmd)" */
+    int status;
+} exec_frame_t;
+
+/*!
+    \internal
+    \brief Scheduling settings applied to a child between fork and exec
+*/
+typedef struct {
+    int flags;
+    int nice;
+    int policy;
+    int ioprio;
+    cpu_set_t cpus;
+} exec_profile_t;
+
+enum exec_profile_flags {
+    PROFILE_NICE = 1,
+    PROFILE_POLICY = 2,
+    PROFILE_IOPRIO = 4,
+    PROFILE_CPUS = 8
+};
+
+/* not exposed by the C library */
+enum {
+    IOPRIO_WHO_PROCESS = 1,
+    IOPRIO_CLASS_SHIFT = 13
+};
+
 typedef struct {
     task_list_t *tasklist;
+    /* command line the program belongs to, 0 if the program is temporary */
+    command_t *command;
+    program_t *program;
+    int in_child;
+    exec_frame_t *capture;
+    const exec_profile_t *profile;
 } exec_context_t;
 
-char* eval_argument(argument_t *argument, exec_context_t *cxt);
-int argv_eval(argv_t *argv, command_t *command, exec_context_t *cxt);
-int exec_setup_redir(command_t *command, exec_context_t *cxt);
-void exec_internal(command_t *command, exec_context_t *cxt);
-void exec_pipechain(command_t *command, exec_context_t *cxt);
+int exec_block(exec_context_t *cxt, size_t pc);
+pid_t exec_start(exec_context_t *cxt, exec_frame_t *frame, int in, int out);
+pid_t exec_start_shared(exec_context_t *cxt, exec_frame_t *frame, int in, int out);
+void exec_frame_share(exec_frame_t *frame, int share);
+int exec_pipe(int fd[2]);
+int exec_is_run(exec_frame_t *frame);
+int exec_start_failure(exec_frame_t *frame);
+void exec_pipe_resize(int fd, size_t size);
+
+/* whether SIGCHLD was received since background tasks were last updated */
+static volatile sig_atomic_t _exec_tasks_pending = 0;
+/* tasklist of the shell, updated while waiting for foreground children */
+static task_list_t *_exec_tasklist = 0;
+/* whether the current process is a copy of the shell, which has no task to manage */
+static int _exec_in_child = 0;
+/* exit status of the last command run in the foreground, $? */
+static int _exec_status = 0;
+/* exit statuses of the stages of the last foreground pipeline, PIPESTATUS */
+static int *_exec_pipestatus = 0;
+static size_t _exec_npipestatus = 0;
+static size_t _exec_apipestatus = 0;
+/* pid of the last command put in the background, $! */
+static pid_t _exec_last_background = 0;
+/* pid of the shell, $$, which its copies keep */
+static pid_t _exec_shell_pid = 0;
+/* process substitutions to reap once the commands using them are done */
+static pid_t *_exec_processes = 0;
+static size_t _exec_nprocesses = 0;
+static size_t _exec_aprocesses = 0;
 
 /*!
     \internal
-    \brief Evaluate an argument_t to a string
+    \brief fork() wrapper
+    Pending output of builtins is flushed first so that it is neither
+    reordered with the output of the child nor duplicated by it. Signals
+    blocked by the shell (e.g. SIGCHLD while the parallel builtin waits for
+    its jobs) are unblocked in the child.
 */
-char* eval_argument(argument_t *argument, exec_context_t *cxt) {
-    char *val = 0;
-    int type = argument_type(argument);
-    if (type == ARGTYPE_STRING) {
-        char *s = argument_get_string(argument);
-        if (s) {
-            val = (char*)yas_malloc((strlen(s) + 1) * sizeof(char));
-            strcpy(val, s);
-        }
-    } else if (type == ARGTYPE_VARIABLE) {
-        char *env = getenv(argument_get_variable(argument));
-        if (env) {
-            val = (char*)yas_malloc((strlen(env) + 1) * sizeof(char));
-            strcpy(val, env);
-        } else {
-            /* empty string for non-existent variables */
-            val = (char*)yas_malloc(sizeof(char));
-            *val = 0;
+pid_t exec_fork() {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (!pid) {
+        _exec_in_child = 1;
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+    }
+    return pid;
+}
+
+/*!
+    \internal
+    \brief Wait for a foreground child
+    \return exit status of the child, 128 + the signal number if it was killed
+    Background tasks that finish meanwhile are updated right away, which may
+    start queued tasks : the shell sleeps until the child or any of them is
+    done. Without background tasks, it simply blocks in waitpid.
+*/
+int exec_wait(pid_t pid) {
+    int stat = 0;
+    pid_t ret;
+    if (_exec_in_child || !task_list_get_size(_exec_tasklist)) {
+        while ((ret = waitpid(pid, &stat, 0)) == -1 && errno == EINTR)
+            ;
+    } else {
+        sigset_t chld, saved, wake;
+        sigemptyset(&chld);
+        sigaddset(&chld, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld, &saved);
+        wake = saved;
+        sigdelset(&wake, SIGCHLD);
+        while ((ret = waitpid(pid, &stat, WNOHANG)) == 0 || (ret == -1 && errno == EINTR)) {
+            if (_exec_tasks_pending)
+                exec_update_tasks(_exec_tasklist);
+            else
+                sigsuspend(&wake);
         }
-    } else if (type == ARGTYPE_COMMAND) {
-        int fd[2];
-        if (pipe(fd)) {
-            fprintf(stderr, "Unable to open pipe.\n");
-            return 0;
+        sigprocmask(SIG_SETMASK, &saved, NULL);
+    }
+    if (ret == -1)
+        return 1;
+    return WIFSIGNALED(stat) ? 128 + WTERMSIG(stat) : WEXITSTATUS(stat);
+}
+
+/*!
+    \internal
+    \return the current word of a frame as a yas_malloc'ed string, and reset it
+*/
+char* exec_word_take(exec_frame_t *frame) {
+    size_t n = string_get_length(frame->word);
+    char *s = (char*)yas_malloc((n + 1) * sizeof(char));
+    if (n)
+        memcpy(s, string_get_cstr(frame->word), n);
+    s[n] = 0;
+    string_clear(frame->word);
+    return s;
+}
+
+/*!
+    \internal
+    \brief Write a whole buffer to a file descriptor
+    \return 0 on success
+*/
+int exec_write_all(int fd, const char *data, size_t sz) {
+    while (sz) {
+        ssize_t n = write(fd, data, sz);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return 1;
+        data += n;
+        sz -= n;
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Get a readable file descriptor holding some data
+    \return a close-on-exec file descriptor, -1 on failure
+    The data is written to an anonymous memory file, sealed against further
+    modifications and rewound, so that the reader gets a regular file without
+    anything touching the filesystem nor a process feeding a pipe. When
+    memfd_create is not supported the data goes through a pipe, which only
+    needs a writer process if the data does not fit in the pipe buffer.
+*/
+int exec_data_fd(const char *data, size_t sz) {
+#ifdef MFD_ALLOW_SEALING
+    int fd = memfd_create("yas-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd != -1) {
+        if (!exec_write_all(fd, data, sz)) {
+            fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+            lseek(fd, 0, SEEK_SET);
+            return fd;
         }
+        close(fd);
+    }
+#endif
+    int p[2];
+    if (pipe(p))
+        return -1;
+    fcntl(p[0], F_SETFD, FD_CLOEXEC);
+    fcntl(p[1], F_SETFD, FD_CLOEXEC);
+    size_t capacity = PIPE_BUF;
+#ifdef F_GETPIPE_SZ
+    if (sz > capacity)
+        exec_pipe_resize(p[1], sz);
+    int pipe_sz = fcntl(p[1], F_GETPIPE_SZ);
+    if (pipe_sz > 0)
+        capacity = pipe_sz;
+#endif
+    if (sz <= capacity) {
+        exec_write_all(p[1], data, sz);
+    } else {
+        /* the writer is orphaned right away so that it is not left as a zombie */
         pid_t pid = fork();
         if (!pid) {
-            dup2(fd[1], STDOUT_FILENO);
-            close(fd[0]);
-            close(fd[1]);
-            command_t *cmd = argument_get_command(argument);
-            if (command_is_pipechain(cmd)) {
-                exec_pipechain(cmd, cxt);
-                exit(0);
-            } else {
-                exec_internal(cmd, cxt);
-            }
-            /* no possible return */
-        } else if (pid == -1) {
-            fprintf(stderr, "Unable to fork.\n");
-            return NULL;
+            close(p[0]);
+            if (!fork())
+                _exit(exec_write_all(p[1], data, sz));
+            _exit(0);
         }
-        close(fd[1]);
-        waitpid(pid, NULL, 0);
-        size_t buffer_size = 0;
-        while (1) {
-            val = (char*)yas_realloc(val, buffer_size + 1024);
-            ssize_t n = read(fd[0], val, 1024);
-            buffer_size += n;
-            if (n < 1024)
-                break;
+        if (pid > 0)
+            while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+                ;
+    }
+    close(p[1]);
+    return p[0];
+}
+
+/*!
+    \internal
+    \brief Open the redirection targets of a frame
+    \param frame Frame to open the redirections of
+    \param in set to the file descriptor of the input redirection, -1 if none
+    \param out set to the file descriptor of the output redirection, -1 if none
+    \return 0 on success
+    The descriptors are close-on-exec : they are meant to be dup'ed over the
+    standard streams.
+*/
+int exec_open_redir(exec_frame_t *frame, int *in, int *out) {
+    *in = *out = -1;
+    if (frame->in && frame->in_data) {
+        *in = exec_data_fd(frame->in, strlen(frame->in));
+        if (*in == -1) {
+            fprintf(stderr, "Unable to store here-document.\n");
+            return 1;
         }
-        if (buffer_size) {
-            val[buffer_size - 1] = 0;
-        } else {
-            yas_free(val);
-            val = 0;
+    } else if (frame->in) {
+        *in = open(frame->in, O_RDONLY | O_CLOEXEC);
+        if (*in == -1) {
+            fprintf(stderr, "Unable to read from %s.\n", frame->in);
+            return 1;
         }
-    } else if (type == ARGTYPE_CAT) {
-        string_t *s = string_new();
-        argument_t **l = argument_get_arguments(argument);
-        while (l && *l) {
-            char *tmp = eval_argument(*l, cxt);
-            if (!tmp) {
-                string_destroy(s);
-                return 0;
-            }
-            string_append_cstr(s, tmp);
-            ++l;
+    }
+    if (frame->out) {
+        *out = open(frame->out, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (*out == -1) {
+            fprintf(stderr, "Unable to write into %s.\n", frame->out);
+            if (*in != -1)
+                close(*in);
+            *in = -1;
+            return 1;
         }
-        val = string_get_cstr(s);
     }
-    return val;
+    return 0;
 }
 
 /*!
     \internal
-    \brief Evaluate the arguments of a command_t to an argv_t
+    \brief Setup the redirections of a frame
+    \note Meant to be called in the child process about to exec the command
 */
-int argv_eval(argv_t *argv, command_t *command, exec_context_t *cxt) {
-    const size_t n = command_argc(command);
-    argument_t **d = command_argv(command);
-    size_t i;
-    for (i = 0; i < n; ++i) {
-        char *s = eval_argument(d[i], cxt);
-        if (s == NULL) {
-            fprintf(stderr, "Argument evaluation failed.\n");
-            argument_inspect(d[i], 0);
-            return 1;
+int exec_setup_redir(exec_frame_t *frame) {
+    int in, out;
+    if (exec_open_redir(frame, &in, &out))
+        return 1;
+    if (in != -1) {
+        dup2(in, STDIN_FILENO);
+        close(in);
+    }
+    if (out != -1) {
+        dup2(out, STDOUT_FILENO);
+        close(out);
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Run a builtin command in the shell process
+    \param cxt Execution context
+    \param builtin Builtin to run
+    \param frame Evaluated command
+    \param out File descriptor to use as standard output, -1 to inherit
+    \return exit status of the builtin, BUILTIN_EXIT for exit
+    The redirections of the frame only apply for the duration of the builtin :
+    the standard streams of the shell are saved and restored around it.
+*/
+int exec_builtin(exec_context_t *cxt, const builtin_t *builtin, exec_frame_t *frame, int out) {
+    int rin, rout, saved_in = -1, saved_out = -1;
+    if (exec_open_redir(frame, &rin, &rout))
+        return 1;
+    if (rout != -1)
+        out = rout;
+    fflush(stdout);
+    if (out != -1) {
+        saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(out, STDOUT_FILENO);
+    }
+    if (rin != -1) {
+        saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(rin, STDIN_FILENO);
+    }
+    builtin_context_t bcxt;
+    bcxt.tasklist = cxt->tasklist;
+    int status = builtin->run(&bcxt, argv_get_argc(frame->argv), argv_get_argv(frame->argv));
+    fflush(stdout);
+    if (out != -1) {
+        if (saved_out != -1)
+            dup2(saved_out, STDOUT_FILENO);
+        else
+            close(STDOUT_FILENO);
+    }
+    if (rin != -1) {
+        if (saved_in != -1)
+            dup2(saved_in, STDIN_FILENO);
+        else
+            close(STDIN_FILENO);
+    }
+    if (saved_out != -1)
+        close(saved_out);
+    if (saved_in != -1)
+        close(saved_in);
+    if (rin != -1)
+        close(rin);
+    if (rout != -1)
+        close(rout);
+    return status;
+}
+
+/*!
+    \internal
+    \return the environment of the command of a frame, to release with
+    exec_envp_release
+    Assignments preceding the command only apply to its environment.
+*/
+char** exec_envp(exec_frame_t *frame) {
+    if (!frame->assign)
+        return var_envp();
+    return var_envp_with(argv_get_argv(frame->assign), argv_get_argc(frame->assign));
+}
+
+/*!
+    \internal
+    \brief Release an environment returned by exec_envp
+*/
+void exec_envp_release(exec_frame_t *frame, char **envp) {
+    if (frame->assign)
+        yas_free(envp);
+}
+
+/*!
+    \internal
+    \brief Replace the current process by an external command
+    \param frame Evaluated command
+    \param stale Descriptor to which a missing cached file is reported, so
+    that the parent can drop the entry, -1 for none
+*/
+void exec_external(exec_frame_t *frame, int stale) {
+    if (exec_setup_redir(frame))
+        exit(1);
+    char **d = argv_get_argv(frame->argv);
+    const char *path = path_lookup(*d);
+    if (path) {
+        char **envp = exec_envp(frame);
+        execve(path, d, envp);
+        if (errno == ENOENT && path != *d && stale != -1) {
+            ssize_t n = write(stale, "", 1);
+            (void)n;
         }
-        int ret = (argument_flags(d[i]) & ARGTYPE_QUOTED)
-                ? argv_add(argv, s)
-                : argv_add_split(argv, s);
-        if (ret)
-            return 1;
+        /* stale entry : fall back to a search of $PATH */
+        environ = envp;
+        execvp(*d, d);
     }
+    fprintf(stderr, "Command not found: %s\n", *d);
+    exit(127);
+}
+
+/*!
+    \internal
+    \brief Perform the redirections of a command without arguments
+    Output files are created or truncated, as in other shells.
+*/
+int exec_redir_only(exec_frame_t *frame) {
+    int in, out;
+    if (exec_open_redir(frame, &in, &out))
+        return 1;
+    if (in != -1)
+        close(in);
+    if (out != -1)
+        close(out);
     return 0;
 }
 
 /*!
     \internal
-    \brief Setup redirections from a command_t
+    \brief Launch an external command with posix_spawn
+    \param frame Evaluated command
+    \param in File descriptor to use as standard input, -1 to inherit
+    \param out File descriptor to use as standard output, -1 to inherit
+    \return pid of the child process, -1 on failure
+    Unlike fork, the cost of posix_spawn does not grow with the memory
+    footprint of the shell. Redirection targets are opened by the shell so
+    that errors are reported as precisely as in the child process.
 */
-int exec_setup_redir(command_t *command, exec_context_t *cxt) {
-    if (command_redir_in(command)) {
-        char *s = eval_argument(command_redir_in(command), cxt);
-        if (s == NULL) {
-            fprintf(stderr, "Argument evaluation failed.\n");
-            argument_inspect(command_redir_in(command), 0);
-            return 1;
+pid_t exec_posix_spawn(exec_frame_t *frame, int in, int out) {
+    int rin, rout;
+    if (exec_open_redir(frame, &rin, &rout))
+        return -1;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_t attr;
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setsigmask(&attr, &none);
+    if (in != -1)
+        posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+    if (out != -1)
+        posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+    if (rin != -1)
+        posix_spawn_file_actions_adddup2(&actions, rin, STDIN_FILENO);
+    if (rout != -1)
+        posix_spawn_file_actions_adddup2(&actions, rout, STDOUT_FILENO);
+    char **d = argv_get_argv(frame->argv);
+    char **envp = exec_envp(frame);
+    pid_t pid;
+    int err = ENOENT;
+    fflush(stdout);
+    const char *path = path_lookup(*d);
+    if (path) {
+        err = posix_spawn(&pid, path, &actions, &attr, d, envp);
+        if (err == ENOENT && path != *d) {
+            /* the cached file disappeared : search $PATH again */
+            path_forget(*d);
+            path = path_lookup(*d);
+            if (path)
+                err = posix_spawn(&pid, path, &actions, &attr, d, envp);
         }
-        int fd = open(s, O_RDONLY);
-        if (fd == -1) {
-            fprintf(stderr, "Unable to read from %s.\n", s);
-            return 1;
+        if (err == ENOEXEC) {
+            /* no "#!" line : run it as a script of /bin/sh, like execvp does */
+            size_t n = argv_get_argc(frame->argv);
+            char *sh[n + 2];
+            sh[0] = "/bin/sh";
+            sh[1] = (char*)path;
+            memcpy(sh + 2, d + 1, n * sizeof(char*));
+            err = posix_spawn(&pid, sh[0], &actions, &attr, sh, envp);
         }
-        dup2(fd, STDIN_FILENO);
-        close(fd);
     }
-    if (command_redir_out(command)) {
-        char *s = eval_argument(command_redir_out(command), cxt);
-        if (s == NULL) {
-            fprintf(stderr, "Argument evaluation failed.\n");
-            argument_inspect(command_redir_out(command), 0);
+    exec_envp_release(frame, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+    if (rin != -1)
+        close(rin);
+    if (rout != -1)
+        close(rout);
+    if (err == ENOENT) {
+        fprintf(stderr, "Command not found: %s\n", *d);
+    } else if (err) {
+        fprintf(stderr, "Unable to run %s : %s\n", *d, strerror(err));
+    } else {
+        return pid;
+    }
+    errno = err;
+    return -1;
+}
+
+/*!
+    \internal
+    \brief Parse a list of CPUs, e.g. "0-3,6"
+    \return 0 on success
+*/
+int exec_parse_cpus(const char *s, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    while (*s) {
+        char *end;
+        long first = strtol(s, &end, 10), last = first;
+        if (end == s || first < 0)
             return 1;
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first)
+                return 1;
         }
-        int fd = open(s, O_WRONLY | O_CREAT);
-        if (fd == -1) {
-            fprintf(stderr, "Unable to write into %s.\n", s);
+        if (last >= CPU_SETSIZE)
+            return 1;
+        for (; first <= last; ++first)
+            CPU_SET(first, cpus);
+        if (*end == ',')
+            ++end;
+        else if (*end)
             return 1;
+        s = end;
+    }
+    return !CPU_COUNT(cpus);
+}
+
+/*!
+    \internal
+    \brief Parse the options of the run prefix
+    run [-n nice] [-s other|batch|idle] [-c cpus] [-i rt|be|idle[:level]] command...
+    \param profile Profile to update
+    \param n Number of arguments, including "run"
+    \param d Arguments
+    \return index of the command in \a d, 0 on error
+*/
+size_t exec_parse_profile(exec_profile_t *profile, size_t n, char **d) {
+    size_t i;
+    for (i = 1; i < n && d[i][0] == '-'; ++i) {
+        const char *opt = d[i];
+        if (!strcmp(opt, "--")) {
+            ++i;
+            break;
         }
-        dup2(fd, STDOUT_FILENO);
-        close(fd);
+        if (!opt[1] || !strchr("nsci", opt[1]) || opt[2] || i + 1 >= n) {
+            fprintf(stderr, "run: usage: run [-n nice] [-s other|batch|idle] [-c cpus] "
+                            "[-i rt|be|idle[:level]] command [arg...]\n");
+            return 0;
+        }
+        const char *v = d[++i];
+        char *end;
+        if (opt[1] == 'n') {
+            profile->nice = strtol(v, &end, 10);
+            if (end == v || *end) {
+                fprintf(stderr, "run: invalid niceness : %s\n", v);
+                return 0;
+            }
+            profile->flags |= PROFILE_NICE;
+        } else if (opt[1] == 's') {
+            if (!strcmp(v, "other")) {
+                profile->policy = SCHED_OTHER;
+            } else if (!strcmp(v, "batch")) {
+                profile->policy = SCHED_BATCH;
+            } else if (!strcmp(v, "idle")) {
+                profile->policy = SCHED_IDLE;
+            } else {
+                fprintf(stderr, "run: invalid scheduling policy : %s\n", v);
+                return 0;
+            }
+            profile->flags |= PROFILE_POLICY;
+        } else if (opt[1] == 'c') {
+            if (exec_parse_cpus(v, &profile->cpus)) {
+                fprintf(stderr, "run: invalid CPU list : %s\n", v);
+                return 0;
+            }
+            profile->flags |= PROFILE_CPUS;
+        } else {
+            /* classes are numbered from 1 : realtime, best-effort, idle */
+            static const char *classes[] = { "rt", "be", "idle" };
+            size_t c, len = strcspn(v, ":");
+            long level = 4;
+            for (c = 0; c < 3; ++c)
+                if (strlen(classes[c]) == len && !strncmp(v, classes[c], len))
+                    break;
+            if (v[len]) {
+                level = strtol(v + len + 1, &end, 10);
+                if (end == v + len + 1 || *end)
+                    level = -1;
+            }
+            if (c == 3 || level < 0 || level > 7) {
+                fprintf(stderr, "run: invalid I/O priority : %s\n", v);
+                return 0;
+            }
+            profile->ioprio = ((int)(c + 1) << IOPRIO_CLASS_SHIFT) | (c == 2 ? 0 : (int)level);
+            profile->flags |= PROFILE_IOPRIO;
+        }
+    }
+    if (i >= n) {
+        fprintf(stderr, "run: missing command\n");
+        return 0;
+    }
+    return i;
+}
+
+/*!
+    \internal
+    \return the profile of background tasks, 0 if the bg_low_priority option
+    is off
+    Background tasks run with a niceness of 10, the SCHED_BATCH policy and the
+    lowest best-effort I/O priority.
+*/
+const exec_profile_t* exec_background_profile() {
+    static exec_profile_t low;
+    if (!option_get(OPTION_BG_LOW_PRIORITY))
+        return 0;
+    low.flags = PROFILE_NICE | PROFILE_POLICY | PROFILE_IOPRIO;
+    low.nice = 10;
+    low.policy = SCHED_BATCH;
+    low.ioprio = (2 << IOPRIO_CLASS_SHIFT) | 7;
+    return &low;
+}
+
+/*!
+    \internal
+    \brief Apply a profile to the current process, i.e. a child about to exec
+    Settings that cannot be applied are reported, the command runs anyway.
+*/
+void exec_apply_profile(const exec_profile_t *profile) {
+    if (!profile)
+        return;
+    if (profile->flags & PROFILE_NICE) {
+        errno = 0;
+        if (nice(profile->nice) == -1 && errno)
+            fprintf(stderr, "run: unable to set niceness : %s\n", strerror(errno));
+    }
+    if (profile->flags & PROFILE_POLICY) {
+        struct sched_param param;
+        param.sched_priority = 0;
+        if (sched_setscheduler(0, profile->policy, &param))
+            fprintf(stderr, "run: unable to set scheduling policy : %s\n", strerror(errno));
+    }
+    if ((profile->flags & PROFILE_CPUS)
+            && sched_setaffinity(0, sizeof(cpu_set_t), &profile->cpus))
+        fprintf(stderr, "run: unable to set CPU affinity : %s\n", strerror(errno));
+    if ((profile->flags & PROFILE_IOPRIO)
+            && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, profile->ioprio))
+        fprintf(stderr, "run: unable to set I/O priority : %s\n", strerror(errno));
+}
+
+/*!
+    \internal
+    \brief Launch an external command in a child process
+    \param frame Evaluated command
+    \param in File descriptor to use as standard input, -1 to inherit
+    \param out File descriptor to use as standard output, -1 to inherit
+    \param profile Scheduling settings of the child, if any
+    \return pid of the child process, -1 on failure
+    posix_spawn is used unless the spawn option is off or a profile is
+    given : posix_spawn cannot run code between fork and exec.
+*/
+pid_t exec_launch(exec_frame_t *frame, int in, int out, const exec_profile_t *profile) {
+    if (option_get(OPTION_SPAWN) && !profile)
+        return exec_posix_spawn(frame, in, out);
+
+    char **d = argv_get_argv(frame->argv);
+    if (!path_lookup(*d)) {
+        fprintf(stderr, "Command not found: %s\n", *d);
+        return -1;
     }
+    /* the child reports a stale entry before exec closes this pipe */
+    int stale[2];
+    if (pipe2(stale, O_CLOEXEC))
+        stale[0] = stale[1] = -1;
+    pid_t pid = exec_fork();
+    if (pid == -1) {
+        fprintf(stderr, "Unable to fork.\n");
+    } else if (!pid) {
+        if (in != -1)
+            dup2(in, STDIN_FILENO);
+        if (out != -1)
+            dup2(out, STDOUT_FILENO);
+        exec_apply_profile(profile);
+        exec_external(frame, stale[1]);
+    }
+    if (stale[0] != -1) {
+        char c;
+        ssize_t n;
+        close(stale[1]);
+        while ((n = read(stale[0], &c, 1)) == -1 && errno == EINTR)
+            ;
+        if (n == 1)
+            path_forget(*d);
+        close(stale[0]);
+    }
+    return pid;
+}
+
+/*!
+    \internal
+    \return whether a new background task must wait in the queue
+    Tasks are queued when the bg_limit option is set and reached, or when
+    other tasks are already waiting, to preserve the FIFO order.
+*/
+int exec_must_queue(task_list_t *tasklist) {
+    int limit = option_get(OPTION_BG_LIMIT);
+    if (limit <= 0 || !tasklist || _exec_in_child)
+        return 0;
+    return task_list_count_running(tasklist) >= (size_t)limit
+        || task_list_count_queued(tasklist);
+}
+
+/*!
+    \internal
+    \brief Put an evaluated background command in the queue of the task list
+    The task takes ownership of the arguments, assignments, redirections and
+    process substitution descriptors of the frame.
+*/
+void exec_enqueue(task_list_t *tasklist, exec_frame_t *frame) {
+    sigset_t chld, saved;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved);
+    task_t *task = task_new();
+    task_set_argv(task, frame->argv);
+    task_set_redir(task, frame->in, frame->in_data, frame->out);
+    task_set_fds(task, frame->fds, frame->nfds);
+    task_set_assign(task, frame->assign);
+    task_list_enqueue(tasklist, task);
+    fprintf(stderr, "[%zu] queued\n", task_list_get_size(tasklist));
+    frame->argv = argv_new();
+    frame->in = 0;
+    frame->out = 0;
+    frame->fds = 0;
+    frame->nfds = 0;
+    frame->assign = 0;
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+}
+
+/*!
+    \internal
+    \brief Set the shell variables assigned by a command without arguments
+    \return 0 on success, 1 if a variable is readonly
+*/
+int exec_assign(exec_frame_t *frame) {
+    size_t i, n = frame->assign ? argv_get_argc(frame->assign) : 0;
+    int status = 0;
+    for (i = 0; i < n; ++i)
+        if (var_assign(argv_get_argv(frame->assign)[i], 0))
+            status = 1;
+    return status;
+}
+
+/*!
+    \internal
+    \brief Run the argument vector of a frame
+    Builtins run in the shell, unless they are put in the background.
+    External commands run in a child process, unless the shell is itself a
+    child process that has nothing left to do. Assignments set shell
+    variables when there is no command, whose exit status is then the one of
+    the last command substitution.
+*/
+int exec_spawn(exec_context_t *cxt, exec_frame_t *frame, int flags) {
+    argv_t *argv = frame->argv;
+    if (cxt->capture) {
+        /* hand the evaluated command over to the caller */
+        *cxt->capture = *frame;
+        cxt->capture->word = 0;
+        frame->argv = argv_new();
+        frame->in = 0;
+        frame->out = 0;
+        frame->fds = 0;
+        frame->nfds = 0;
+        frame->assign = 0;
+        return EXEC_OK;
+    }
+    if (!argv_get_argc(argv)) {
+        _exec_status = exec_redir_only(frame);
+        if (!_exec_status && !(flags & OPFLAG_BACKGROUND))
+            _exec_status = exec_assign(frame);
+        if (_exec_status)
+            return EXEC_ERROR;
+        /* e.g. "x=$(cmd)" gets the exit status of cmd */
+        _exec_status = frame->status;
+        return EXEC_OK;
+    }
+    const builtin_t *builtin = builtin_find(*argv_get_argv(argv));
+    if (builtin && !(flags & OPFLAG_BACKGROUND)) {
+        int status = exec_builtin(cxt, builtin, frame, -1);
+        if (status == BUILTIN_EXIT)
+            return EXEC_EXIT;
+        _exec_status = status;
+        return EXEC_OK;
+    }
+    if (cxt->in_child && !builtin && !exec_is_run(frame)) {
+        exec_frame_share(frame, 1);
+        exec_external(frame, -1);
+    }
+    _exec_status = 0;
+    if ((flags & OPFLAG_BACKGROUND) && exec_must_queue(cxt->tasklist)) {
+        exec_enqueue(cxt->tasklist, frame);
+        return EXEC_OK;
+    }
+    exec_context_t bg = *cxt;
+    if (flags & OPFLAG_BACKGROUND)
+        bg.profile = exec_background_profile();
+    pid_t pid = exec_start(&bg, frame, -1, -1);
+    if (pid == -1) {
+        _exec_status = exec_start_failure(frame);
+        return EXEC_ERROR;
+    }
+    if (flags & OPFLAG_BACKGROUND) {
+        task_t *task = task_new();
+        task_set_pid(task, pid);
+        task_set_argv(task, argv);
+        task_list_add(cxt->tasklist, task);
+        fprintf(stderr, "[%zu] %u\n", task_list_get_size(cxt->tasklist), pid);
+        _exec_last_background = pid;
+        /* the task now owns the argv */
+        frame->argv = argv_new();
+    } else if (pid) {
+        _exec_status = exec_wait(pid);
+    }
+    return EXEC_OK;
+}
+
+/*!
+    \internal
+    \brief Evaluate a block without running it
+    \param cxt Execution context
+    \param block Index of the first instruction of the block
+    \param frame Frame receiving the evaluated command, to be released with
+    exec_frame_release
+    \return EXEC_OK on success
+*/
+int exec_capture(exec_context_t *cxt, size_t block, exec_frame_t *frame) {
+    memset(frame, 0, sizeof(exec_frame_t));
+    exec_context_t sub = *cxt;
+    sub.capture = frame;
+    return exec_block(&sub, block);
+}
+
+/*!
+    \internal
+    \brief Close the process substitution descriptors of a frame
+    Once the command has started, this lets the processes see the end of
+    their input, or the command the end of their output.
+*/
+void exec_frame_close(exec_frame_t *frame) {
+    size_t i;
+    for (i = 0; i < frame->nfds; ++i)
+        close(frame->fds[i]);
+    yas_free(frame->fds);
+    frame->fds = 0;
+    frame->nfds = 0;
+}
+
+/*!
+    \internal
+    \brief Make the process substitution descriptors of a frame inheritable
+    \param share 1 before starting the command, 0 afterwards so that other
+    commands (e.g. queued tasks) do not keep the pipes open
+*/
+void exec_frame_share(exec_frame_t *frame, int share) {
+    size_t i;
+    for (i = 0; i < frame->nfds; ++i)
+        fcntl(frame->fds[i], F_SETFD, share ? 0 : FD_CLOEXEC);
+}
+
+/*!
+    \internal
+    \brief Wait for the process substitutions started since \a mark
+*/
+void exec_reap_processes(size_t mark) {
+    while (_exec_nprocesses > mark)
+        exec_wait(_exec_processes[--_exec_nprocesses]);
+}
+
+/*!
+    \internal
+    \brief Start a process substitution and append its path to the current word
+    \param cxt Execution context
+    \param instr OP_PROCESS instruction
+    \param frame Frame of the command using the substitution
+    \return 0 on success
+    The block runs in a copy of the shell connected to a pipe, whose other
+    end is named by a /dev/fd path. The process is reaped with the command,
+    except for background commands : it is then orphaned right away so that
+    the shell needs not wait for it.
+*/
+int exec_process(exec_context_t *cxt, const instr_t *instr, exec_frame_t *frame) {
+    int fd[2];
+    if (exec_pipe(fd)) {
+        fprintf(stderr, "Unable to open pipe.\n");
+        return 1;
+    }
+    int out = instr->flags & OPFLAG_PROCESS_OUT;
+    int mine = out ? fd[1] : fd[0], theirs = out ? fd[0] : fd[1];
+    pid_t pid = exec_fork();
+    if (!pid) {
+        if ((instr->flags & OPFLAG_BACKGROUND) && fork())
+            _exit(0);
+        dup2(theirs, out ? STDIN_FILENO : STDOUT_FILENO);
+        close(theirs);
+        close(mine);
+        exec_frame_close(frame);
+        builtin_coproc_detach();
+        exec_context_t sub = *cxt;
+        sub.in_child = 1;
+        sub.capture = 0;
+        exit(exec_block(&sub, instr->a) == EXEC_ERROR ? 1 : _exec_status);
+    }
+    close(theirs);
+    if (pid == -1) {
+        fprintf(stderr, "Unable to fork.\n");
+        close(mine);
+        return 1;
+    }
+    if (instr->flags & OPFLAG_BACKGROUND) {
+        while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+            ;
+    } else {
+        if (_exec_nprocesses == _exec_aprocesses) {
+            _exec_aprocesses = _exec_aprocesses ? 2 * _exec_aprocesses : 8;
+            _exec_processes = (pid_t*)yas_realloc(_exec_processes, _exec_aprocesses * sizeof(pid_t));
+        }
+        _exec_processes[_exec_nprocesses++] = pid;
+    }
+    frame->fds = (int*)yas_realloc(frame->fds, (frame->nfds + 1) * sizeof(int));
+    frame->fds[frame->nfds++] = mine;
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/fd/%d", mine);
+    string_append_cstr(frame->word, path);
     return 0;
 }
 
 /*!
     \internal
-    \brief Try to exec one of the builtin commands
+    \brief Release the resources held by a frame filled by exec_capture
+*/
+void exec_frame_release(exec_frame_t *frame) {
+    argv_destroy(frame->argv);
+    argv_destroy(frame->assign);
+    yas_free(frame->in);
+    yas_free(frame->out);
+    exec_frame_close(frame);
+}
+
+/*!
+    \internal
+    \return whether an evaluated command starts with the run prefix
 */
-int exec_builtin(argv_t *argv, exec_context_t *cxt, int *exit) {
-    if (exit)
-        *exit = 0;
-    size_t n = argv_get_argc(argv);
-    char **d = argv_get_argv(argv);
-    if (!n || !d)
+int exec_is_run(exec_frame_t *frame) {
+    return argv_get_argc(frame->argv) && !strcmp(*argv_get_argv(frame->argv), "run");
+}
+
+/*!
+    \internal
+    \return exit status of a command that exec_start failed to start : 127
+    if it cannot be found, 1 otherwise
+*/
+int exec_start_failure(exec_frame_t *frame) {
+    char **d = argv_get_argv(frame->argv);
+    if (!argv_get_argc(frame->argv) || exec_is_run(frame) || builtin_find(*d))
         return 1;
-    /* try builtin commands */
-    if (!strcmp(*d, "cd")) {
-        if (n > 1) {
-            if (chdir(d[1]))
-                fprintf(stderr, "No such directory : %s\n", d[1]);
-        } else {
-            char *homedir = get_homedir();
-            if (homedir) {
-                chdir(homedir);
-                free(homedir);
-            } else {
-                fprintf(stderr, "Unable to find home directory\n");
+    return path_lookup(*d) ? 1 : 127;
+}
+
+/*!
+    \internal
+    \brief Start a command prefixed with run, applying its scheduling settings
+    Settings of the context (e.g. those of background tasks) are overridden by
+    those given explicitly.
+*/
+pid_t exec_start_run(exec_context_t *cxt, exec_frame_t *frame, int in, int out) {
+    exec_profile_t profile;
+    if (cxt->profile)
+        profile = *cxt->profile;
+    else
+        profile.flags = 0;
+    size_t i, n = argv_get_argc(frame->argv);
+    char **d = argv_get_argv(frame->argv);
+    size_t first = exec_parse_profile(&profile, n, d);
+    if (!first)
+        return -1;
+    exec_frame_t sub_frame = *frame;
+    sub_frame.argv = argv_new();
+    for (i = first; i < n; ++i)
+        argv_add(sub_frame.argv, d[i]);
+    exec_context_t sub = *cxt;
+    sub.profile = &profile;
+    pid_t pid = exec_start(&sub, &sub_frame, in, out);
+    argv_destroy(sub_frame.argv);
+    return pid;
+}
+
+/*!
+    \internal
+    \brief Start an evaluated command in a child process
+    \param cxt Execution context
+    \param frame Evaluated command
+    \param in File descriptor to use as standard input, -1 to inherit
+    \param out File descriptor to use as standard output, -1 to inherit
+    \return pid of the child process, 0 if there is nothing to wait for, -1
+    on failure
+    External commands are launched directly while builtins need a copy of the
+    shell to run in.
+*/
+pid_t exec_start(exec_context_t *cxt, exec_frame_t *frame, int in, int out) {
+    if (!argv_get_argc(frame->argv))
+        return exec_redir_only(frame) ? -1 : 0;
+    exec_frame_share(frame, 1);
+    pid_t pid = exec_start_shared(cxt, frame, in, out);
+    exec_frame_share(frame, 0);
+    return pid;
+}
+
+/*!
+    \internal
+    \brief Start a command whose process substitution descriptors are inheritable
+*/
+pid_t exec_start_shared(exec_context_t *cxt, exec_frame_t *frame, int in, int out) {
+    pid_t pid;
+    if (exec_is_run(frame))
+        return exec_start_run(cxt, frame, in, out);
+    const builtin_t *builtin = builtin_find(*argv_get_argv(frame->argv));
+    if (!builtin)
+        return exec_launch(frame, in, out, cxt->profile);
+    pid = exec_fork();
+    if (!pid) {
+        if (in != -1)
+            dup2(in, STDIN_FILENO);
+        if (out != -1)
+            dup2(out, STDOUT_FILENO);
+        exec_apply_profile(cxt->profile);
+        exec_context_t sub = *cxt;
+        sub.in_child = 1;
+        sub.capture = 0;
+        int status = exec_builtin(&sub, builtin, frame, -1);
+        exit(status == BUILTIN_EXIT ? _exec_status : status);
+    } else if (pid == -1) {
+        fprintf(stderr, "Unable to fork.\n");
+    }
+    return pid;
+}
+
+/*!
+    \internal
+    \brief Start a stage of a pipeline
+    \param cxt Execution context
+    \param block Index of the first instruction of the stage
+    \param in File descriptor to use as standard input, -1 to inherit
+    \param out File descriptor to use as standard output, -1 to inherit
+    \param tail Whether this is the last stage and nothing is left to do once
+    it is done
+    \param error Set to the exit status of the stage when it fails to start
+    \return pid of the child process, 0 if there is nothing to wait for, -1
+    on failure
+    The arguments are evaluated by the shell. In a copy of the shell (e.g.
+    running a pipeline for a command substitution), an external command in
+    the last stage replaces the copy instead of running in yet another child
+    process that the copy would only wait for.
+*/
+pid_t exec_stage(exec_context_t *cxt, size_t block, int in, int out, int tail,
+                 int *error) {
+    exec_frame_t frame;
+    pid_t pid = -1;
+    *error = 1;
+    if (exec_capture(cxt, block, &frame) == EXEC_OK) {
+        if (tail && cxt->in_child && out == -1
+                && argv_get_argc(frame.argv)
+                && !exec_is_run(&frame)
+                && !builtin_find(*argv_get_argv(frame.argv))) {
+            if (in != -1) {
+                dup2(in, STDIN_FILENO);
+                close(in);
             }
+            exec_frame_share(&frame, 1);
+            exec_external(&frame, -1);
         }
-        return 0;
-    } else if (!strcmp(*d, "exit")) {
-        if (exit) {
-            *exit = 1;
+        pid = exec_start(cxt, &frame, in, out);
+        if (pid == -1)
+            *error = exec_start_failure(&frame);
+    }
+    exec_frame_release(&frame);
+    return pid;
+}
+
+/*!
+    \internal
+    \brief Create a pipe whose ends are not inherited by exec'ed commands
+*/
+int exec_pipe(int fd[2]) {
+    if (pipe(fd))
+        return 1;
+    fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fd[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Set the buffer size of a pipe
+    \param fd Either end of the pipe
+    \param size Requested size in bytes, capped at /proc/sys/fs/pipe-max-size
+    Failures are ignored : the pipe keeps its previous size.
+*/
+void exec_pipe_resize(int fd, size_t size) {
+#ifdef F_SETPIPE_SZ
+    static long max_size = 0;
+    if (!max_size) {
+        FILE *f = fopen("/proc/sys/fs/pipe-max-size", "r");
+        if (!f || fscanf(f, "%ld", &max_size) != 1 || max_size <= 0)
+            max_size = 1048576;
+        if (f)
+            fclose(f);
+    }
+    if (size > (size_t)max_size)
+        size = max_size;
+    fcntl(fd, F_SETPIPE_SZ, (int)size);
+#else
+    (void)fd;
+    (void)size;
+#endif
+}
+
+/*!
+    \internal
+    \brief Append everything that can be read from a file descriptor to a string
+    \return 0 on success
+*/
+int exec_read_all(int fd, string_t *word) {
+    while (1) {
+        char buffer[65536];
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n > 0)
+            string_append_cstrn(word, buffer, n);
+        else if (!n)
             return 0;
+        else if (errno != EINTR)
+            return 1;
+    }
+}
+
+/*!
+    \internal
+    \brief Append the content of a file to a string, as $(< file) does
+    \return 0 on success
+*/
+int exec_read_file(const char *path, string_t *word) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "Unable to read from %s.\n", path);
+        return 1;
+    }
+    int ret = 0;
+    struct stat st;
+    void *d = fstat(fd, &st) || !S_ISREG(st.st_mode) || !st.st_size
+            ? MAP_FAILED
+            : mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (d != MAP_FAILED) {
+        string_append_cstrn(word, (const char*)d, st.st_size);
+        munmap(d, st.st_size);
+    } else {
+        ret = exec_read_all(fd, word);
+    }
+    close(fd);
+    return ret;
+}
+
+/*!
+    \internal
+    \return a file descriptor to capture the output of builtins into, -1 if
+    none is available
+    A single anonymous in-memory file is created and reused : captures never
+    nest since arguments are evaluated before builtins run.
+*/
+int exec_capture_fd() {
+    static int fd = -2;
+    if (fd == -2) {
+        fd = memfd_create("yas-capture", MFD_CLOEXEC);
+        if (fd == -1) {
+            FILE *f = tmpfile();
+            if (f) {
+                fd = fcntl(fileno(f), F_DUPFD_CLOEXEC, 0);
+                fclose(f);
+            }
         }
-    } else if (!strcmp(*d, "list_tasks") || !strcmp(*d, "liste_ps")) {
-        size_t i, n = task_list_get_size(cxt->tasklist);
-        for (i = 0; i < n; ++i)
-            task_inspect(task_list_get_task(cxt->tasklist, i));
-        return 0;
     }
-    return 1;
+    return fd;
 }
 
 /*!
     \internal
-    \brief Helper to execute a single command
+    \brief Run a builtin in the shell process, appending its output to a string
+    \param status Set to the exit status of the builtin
+    \return 0 on success, -1 if the output could not be captured
 */
-void exec_internal(command_t *command, exec_context_t *cxt) {
-    argv_t *argv = argv_new();
-    if (argv_eval(argv, command, cxt))
-        exit(1);
-    if (exec_setup_redir(command, cxt))
-        exit(1);
-    if (!exec_builtin(argv, cxt, 0))
-        exit(0);
-    /* exec external command */
-    char **d = argv_get_argv(argv);
-    int errcode = execvp(*d, d);
-    fprintf(stderr, "Command not found: %s\n", *d);
-    exit(errcode);
+int exec_builtin_output(exec_context_t *cxt, const builtin_t *builtin, exec_frame_t *frame,
+                        string_t *word, int *status) {
+    int fd = exec_capture_fd();
+    if (fd == -1)
+        return -1;
+    *status = exec_builtin(cxt, builtin, frame, fd);
+    /* fd shares its offset with the former stdout, which now is the size of the output */
+    off_t sz = lseek(fd, 0, SEEK_CUR);
+    lseek(fd, 0, SEEK_SET);
+    int ret = 0;
+    while (sz > 0) {
+        char buffer[65536];
+        ssize_t n = read(fd, buffer, sz < (off_t)sizeof(buffer) ? (size_t)sz : sizeof(buffer));
+        if (n <= 0 && errno != EINTR) {
+            ret = 1;
+            break;
+        } else if (n > 0) {
+            string_append_cstrn(word, buffer, n);
+            sz -= n;
+        }
+    }
+    ftruncate(fd, 0);
+    lseek(fd, 0, SEEK_SET);
+    return ret;
 }
 
 /*!
     \internal
-    \brief Helper to execute a pipechain
+    \brief Append the output of a command, run in a child process, to a string
+    \param status Set to the exit status of the command
+    \return 0 on success
+    The output is read until EOF, whatever its size.
 */
-void exec_pipechain(command_t *command, exec_context_t *cxt) {
-    size_t i = 0;
-    const size_t n = command_argc(command);
-    argument_t **d = command_argv(command);
-    
-    int fd[2], pfd = STDIN_FILENO;
+int exec_child_output(exec_context_t *cxt, size_t block, exec_frame_t *frame,
+                      string_t *word, int *status) {
+    int fd[2];
+    if (exec_pipe(fd)) {
+        fprintf(stderr, "Unable to open pipe.\n");
+        return 1;
+    }
+    pid_t pid;
+    if (frame) {
+        pid = exec_start(cxt, frame, -1, fd[1]);
+    } else {
+        /* pipelines run in a copy of the shell */
+        pid = exec_fork();
+        if (!pid) {
+            dup2(fd[1], STDOUT_FILENO);
+            builtin_coproc_detach();
+            exec_context_t sub = *cxt;
+            sub.in_child = 1;
+            sub.capture = 0;
+            exit(exec_block(&sub, block) == EXEC_ERROR ? 1 : _exec_status);
+        } else if (pid == -1) {
+            fprintf(stderr, "Unable to fork.\n");
+        }
+    }
+    *status = pid != -1 ? 0 : frame ? exec_start_failure(frame) : 1;
+    close(fd[1]);
+    /* the pipe must be drained before reaping the child, which would otherwise
+       block forever on a full pipe */
+    int ret = pid == -1;
+    if (pid > 0 && exec_read_all(fd[0], word)) {
+        fprintf(stderr, "Unable to read command output.\n");
+        ret = 1;
+    }
+    close(fd[0]);
+    if (pid > 0)
+        *status = exec_wait(pid);
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Append the output of a block to a string
+    \param status Set to the exit status of the block
+    \return 0 on success
+    An empty output is not an error. Trailing newlines are removed.
+    Simple commands are evaluated by the shell first, which allows to avoid
+    creating a process altogether in two cases : builtins without side effects
+    on the shell, whose output is captured, and $(< file), which reads the
+    file directly.
+*/
+int exec_substitution(exec_context_t *cxt, size_t block, string_t *word, int *status) {
+    int ret;
+    size_t start = string_get_length(word);
+    int op = program_code(cxt->program)[block].op;
+    *status = 0;
+    if (op == OP_PIPE || op == OP_LIST) {
+        ret = exec_child_output(cxt, block, 0, word, status);
+    } else {
+        exec_frame_t frame;
+        ret = exec_capture(cxt, block, &frame) != EXEC_OK;
+        size_t argc = ret ? 0 : argv_get_argc(frame.argv);
+        const builtin_t *builtin = argc ? builtin_find(*argv_get_argv(frame.argv)) : 0;
+        if (ret) {
+            /* evaluation failed, error already reported */
+        } else if (!argc && frame.in && frame.in_data && !frame.out) {
+            string_append_cstr(word, frame.in);
+        } else if (!argc && frame.in && !frame.out) {
+            ret = exec_read_file(frame.in, word);
+        } else if (builtin && (builtin->flags & BUILTIN_PURE)
+                && (ret = exec_builtin_output(cxt, builtin, &frame, word, status)) != -1) {
+            /* output captured in the shell process */
+        } else {
+            ret = exec_child_output(cxt, block, &frame, word, status);
+        }
+        exec_frame_release(&frame);
+        if (ret && !*status)
+            *status = 1;
+    }
+    /* trailing newlines are removed */
+    size_t end = string_get_length(word);
+    const char *d = string_get_cstr(word);
+    while (end > start && d[end - 1] == '\n')
+        --end;
+    string_shrink(word, string_get_length(word) - end);
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Make room for the exit statuses of a pipeline of \a n stages
+*/
+void exec_pipestatus_reserve(size_t n) {
+    if (n > _exec_apipestatus) {
+        _exec_apipestatus = n > 8 ? n : 8;
+        _exec_pipestatus = (int*)yas_realloc(_exec_pipestatus, _exec_apipestatus * sizeof(int));
+    }
+    _exec_npipestatus = n;
+}
+
+/*!
+    \internal
+    \brief Run a pipeline
+    \param cxt Execution context
+    \param pc Index of the first OP_STAGE instruction
+    \param n Number of stages
+    The exit status of every stage is recorded in PIPESTATUS. The exit status
+    of the pipeline is the one of its last stage or, with the pipefail
+    option, the one of the last stage that failed.
+*/
+int exec_pipeline(exec_context_t *cxt, size_t pc, size_t n) {
+    const instr_t *stage = program_code(cxt->program) + pc;
+    int fd[2], pfd = -1;
     pid_t pid[n];
+    int status[n];
+    size_t i, started = 0;
     
-    while (i < n) {
-        if (i + 1 < n && pipe(fd)) {
+    for (i = 0; i < n; ++i) {
+        if (i + 1 < n && exec_pipe(fd)) {
             fprintf(stderr, "unable to open pipe...\n");
-            exit(1);
+            break;
         }
-        pid[i] = fork();
-        if (!pid[i]) {
-            dup2(pfd, STDIN_FILENO);
-            close(pfd);
-            if (i + 1 < n) {
-                dup2(fd[1], STDOUT_FILENO);
-                close(fd[0]);
-                close(fd[1]);
-            }
-            /* exec_internal never returns... */
-            exec_internal(argument_get_command(d[i]), cxt);
+        if (i + 1 < n) {
+            /* per-pipe syntax, e.g. "a |{1M} b", overrides the shell option */
+            int log2 = (stage[i].flags & OPFLAG_PIPE_SIZE_MASK) >> OPFLAG_PIPE_SIZE_SHIFT;
+            size_t size = log2 ? (size_t)1 << log2 : (size_t)option_get(OPTION_PIPE_SIZE);
+            if (size)
+                exec_pipe_resize(fd[1], size);
         }
-        if (command_is_background(argument_get_command(d[i]))) {
+        int last = i + 1 == n;
+        int error;
+        pid[i] = exec_stage(cxt, stage[i].a, pfd, last ? -1 : fd[1], last, &error);
+        status[i] = 0;
+        if (pid[i] == -1) {
+            status[i] = error;
             pid[i] = 0;
-            /* TODO: add to list? */
         }
-        close(fd[1]);
-        pfd = fd[0];
-        ++i;
+        ++started;
+        if (pfd != -1)
+            close(pfd);
+        if (i + 1 < n) {
+            close(fd[1]);
+            pfd = fd[0];
+        }
     }
-    for (i = 0; i < n; ++i)
-        if (pid[i])
-            waitpid(pid[i], NULL, 0);
+    if (pfd != -1 && started < n)
+        close(pfd);
+    for (i = 0; i < n; ++i) {
+        if (i >= started)
+            status[i] = 1;
+        else if (pid[i])
+            status[i] = exec_wait(pid[i]);
+    }
+    exec_pipestatus_reserve(n);
+    memcpy(_exec_pipestatus, status, n * sizeof(int));
+    _exec_status = status[n - 1];
+    for (i = n; option_get(OPTION_PIPEFAIL) && !_exec_status && i > 0; --i)
+        _exec_status = status[i - 1];
+    return started == n ? EXEC_OK : EXEC_ERROR;
+}
+
+/*!
+    \internal
+    \brief Run a list
+    \param cxt Execution context
+    \param pc Index of the first OP_ITEM instruction
+    \param n Number of elements
+    Elements run one after the other in the shell, each of them setting the
+    exit status that the '&&' and '||' conditions of the next one test. An
+    element that fails to run has an exit status of 1.
+*/
+int exec_list(exec_context_t *cxt, size_t pc, size_t n) {
+    const instr_t *item = program_code(cxt->program) + pc;
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        if (((item[i].flags & OPFLAG_AND) && _exec_status)
+                || ((item[i].flags & OPFLAG_OR) && !_exec_status))
+            continue;
+        /* only the last element may replace a copy of the shell */
+        exec_context_t sub = *cxt;
+        sub.in_child = cxt->in_child && i + 1 == n;
+        int ret = exec_block(&sub, item[i].a);
+        if (ret == EXEC_EXIT)
+            return ret;
+        if (ret == EXEC_ERROR && !_exec_status)
+            _exec_status = 1;
+    }
+    return EXEC_OK;
+}
+
+/*!
+    \internal
+    \brief Fork a copy of the shell running a list or a pipeline
+    \param cxt Execution context
+    \param block Index of the first instruction of the list or pipeline
+    \return pid of the copy, -1 on failure
+*/
+pid_t exec_background_start(exec_context_t *cxt, size_t block) {
+    pid_t pid = exec_fork();
+    if (!pid) {
+        /* the copy may well outlive "coproc -c" */
+        builtin_coproc_detach();
+        exec_apply_profile(exec_background_profile());
+        exec_context_t sub = *cxt;
+        sub.in_child = 1;
+        sub.capture = 0;
+        sub.profile = 0;
+        int ret = exec_block(&sub, block);
+        exit(ret == EXEC_ERROR && !_exec_status ? 1 : _exec_status);
+    } else if (pid == -1) {
+        fprintf(stderr, "Unable to fork.\n");
+    }
+    return pid;
+}
+
+/*!
+    \internal
+    \brief Run a list or a pipeline in the background
+    \param cxt Execution context
+    \param block Index of the first instruction of the list or pipeline
+    \param frame Frame whose current word describes the command
+    \return EXEC_OK on success
+    The command runs in the foreground of a copy of the shell, which is
+    registered as a single task. A queued task keeps a reference to the
+    command line instead, and its copy is only forked by exec_dequeue.
+*/
+int exec_background(exec_context_t *cxt, size_t block, exec_frame_t *frame) {
+    char *text = exec_word_take(frame);
+    argv_t *argv = argv_new();
+    argv_add(argv, text);
+    yas_free(text);
+    sigset_t chld, saved;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved);
+    task_t *task = task_new();
+    task_set_argv(task, argv);
+    int ret = EXEC_OK;
+    _exec_status = 0;
+    /* the program must outlive the command line, i.e. belong to the command */
+    if (cxt->command && command_program(cxt->command) == cxt->program
+            && exec_must_queue(cxt->tasklist)) {
+        task_set_block(task, cxt->command, block);
+        task_list_enqueue(cxt->tasklist, task);
+        fprintf(stderr, "[%zu] queued\n", task_list_get_size(cxt->tasklist));
+    } else {
+        pid_t pid = exec_background_start(cxt, block);
+        if (pid == -1) {
+            task_destroy(task);
+            _exec_status = 1;
+            ret = EXEC_ERROR;
+        } else {
+            task_set_pid(task, pid);
+            task_list_add(cxt->tasklist, task);
+            fprintf(stderr, "[%zu] %u\n", task_list_get_size(cxt->tasklist), pid);
+            _exec_last_background = pid;
+        }
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Append the value of a variable to a word
+    The special variables $?, $!, $$ and PIPESTATUS (the exit statuses of the
+    stages of the last pipeline, separated by spaces) are maintained here
+    rather than in the variable store. Variables that are not set expand to
+    empty strings.
+*/
+void exec_variable(const char *name, string_t *word) {
+    char buffer[32];
+    if (name[0] && !name[1] && (name[0] == '?' || name[0] == '!' || name[0] == '$')) {
+        long value = _exec_status;
+        if (name[0] == '!') {
+            if (!_exec_last_background)
+                return;
+            value = _exec_last_background;
+        } else if (name[0] == '$') {
+            value = _exec_shell_pid ? _exec_shell_pid : getpid();
+        }
+        snprintf(buffer, sizeof(buffer), "%ld", value);
+        string_append_cstr(word, buffer);
+    } else if (name[0] == 'P' && !strcmp(name, "PIPESTATUS")) {
+        size_t i;
+        for (i = 0; i < _exec_npipestatus; ++i) {
+            snprintf(buffer, sizeof(buffer), i ? " %d" : "%d", _exec_pipestatus[i]);
+            string_append_cstr(word, buffer);
+        }
+    } else {
+        string_append_cstr(word, var_get(name));
+    }
+}
+
+/*!
+    \internal
+    \brief Append the value of an arithmetic expression to a word
+    \return 0 on success
+*/
+int exec_arithmetic(const char *expr, string_t *word) {
+    long long value;
+    const char *error;
+    if (arith_eval(expr, &value, &error)) {
+        fprintf(stderr, "Arithmetic error in \"%s\" : %s\n", expr, error);
+        return 1;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld", value);
+    string_append_cstr(word, buffer);
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Interpret a block of the current program
+    \param cxt Execution context
+    \param pc Index of the first instruction of the block
+*/
+int exec_block(exec_context_t *cxt, size_t pc) {
+    const instr_t *code = program_code(cxt->program);
+    exec_frame_t frame;
+    frame.argv = argv_new();
+    frame.word = string_new();
+    frame.in = 0;
+    frame.out = 0;
+    frame.in_data = 0;
+    frame.fds = 0;
+    frame.nfds = 0;
+    frame.assign = 0;
+    frame.status = 0;
+    size_t mark = _exec_nprocesses;
+    int ret = EXEC_OK;
+    for (; ret == EXEC_OK && code[pc].op != OP_END; ++pc) {
+        const instr_t *i = code + pc;
+        switch (i->op) {
+            case OP_LITERAL:
+                string_append_cstr(frame.word, program_string(cxt->program, i->a));
+                break;
+            case OP_VARIABLE:
+                exec_variable(program_string(cxt->program, i->a), frame.word);
+                break;
+            case OP_ARITH:
+                if (exec_arithmetic(program_string(cxt->program, i->a), frame.word)) {
+                    _exec_status = 1;
+                    ret = EXEC_ERROR;
+                }
+                break;
+            case OP_SUBST:
+                if (exec_substitution(cxt, i->a, frame.word, &frame.status)) {
+                    fprintf(stderr, "Argument evaluation failed.\n");
+                    _exec_status = 1;
+                    ret = EXEC_ERROR;
+                }
+                break;
+            case OP_FIELD:
+            case OP_SPLIT:
+            {
+                char *s = exec_word_take(&frame);
+                if (i->op == OP_FIELD ? argv_add(frame.argv, s) : argv_add_split(frame.argv, s)) {
+                    _exec_status = 1;
+                    ret = EXEC_ERROR;
+                }
+                yas_free(s);
+                break;
+            }
+            case OP_REDIR_IN:
+            case OP_REDIR_DATA:
+                yas_free(frame.in);
+                frame.in = exec_word_take(&frame);
+                frame.in_data = i->op == OP_REDIR_DATA;
+                break;
+            case OP_REDIR_OUT:
+                yas_free(frame.out);
+                frame.out = exec_word_take(&frame);
+                break;
+            case OP_ASSIGN:
+            {
+                char *s = exec_word_take(&frame);
+                if ((i->flags & OPFLAG_ASSIGN_NOW) && !cxt->capture) {
+                    /* later words of the command see the new value */
+                    int failed = var_assign(s, 0);
+                    yas_free(s);
+                    if (failed) {
+                        _exec_status = 1;
+                        ret = EXEC_ERROR;
+                    }
+                    break;
+                }
+                if (!frame.assign)
+                    frame.assign = argv_new();
+                argv_add(frame.assign, s);
+                yas_free(s);
+                break;
+            }
+            case OP_SPAWN:
+                ret = exec_spawn(cxt, &frame, i->flags);
+                if (!cxt->capture) {
+                    /* a simple command is a pipeline of one stage */
+                    exec_pipestatus_reserve(1);
+                    _exec_pipestatus[0] = _exec_status;
+                }
+                break;
+            case OP_PIPE:
+                ret = exec_pipeline(cxt, pc + 1, i->a);
+                pc += i->a;
+                break;
+            case OP_LIST:
+                ret = exec_list(cxt, pc + 1, i->a);
+                pc += i->a;
+                break;
+            case OP_BACKGROUND:
+                ret = exec_background(cxt, i->a, &frame);
+                break;
+            case OP_PROCESS:
+                if (exec_process(cxt, i, &frame)) {
+                    _exec_status = 1;
+                    ret = EXEC_ERROR;
+                }
+                break;
+            default:
+                fprintf(stderr, "Invalid instruction %u at %zu\n", i->op, pc);
+                ret = EXEC_ERROR;
+                break;
+        }
+    }
+    argv_destroy(frame.argv);
+    argv_destroy(frame.assign);
+    string_destroy(frame.word);
+    yas_free(frame.in);
+    yas_free(frame.out);
+    exec_frame_close(&frame);
+    /* when evaluating a pipeline stage, the pipeline reaps the processes */
+    if (!cxt->capture)
+        exec_reap_processes(mark);
+    return ret;
+}
+
+/*!
+    \internal
+    \brief Get the compiled form of a command_t, compiling it if needed
+    The resulting program_t is kept along with the command, so that commands
+    executed repeatedly (e.g. from the command cache) are compiled only once.
+*/
+program_t* exec_get_program(command_t *command) {
+    program_t *program = command_program(command);
+    if (!program) {
+        program = program_compile(command);
+        command_set_program(command, program);
+    }
+    return program;
 }
 
 /*!
@@ -294,44 +1718,257 @@ void exec_pipechain(command_t *command, exec_context_t *cxt) {
     \param tasklist Tasklist to add background tasks to, if any
 */
 int exec_command(command_t *command, task_list_t *tasklist) {
+    _exec_tasklist = tasklist;
+    exec_poll_tasks(tasklist);
+    if (!_exec_shell_pid)
+        _exec_shell_pid = getpid();
     exec_context_t cxt;
     cxt.tasklist = tasklist;
-    if (command_is_pipechain(command)) {
-        exec_pipechain(command, &cxt);
-    } else {
-        argv_t *argv = argv_new();
-        if (argv_eval(argv, command, &cxt)) {
-            argv_destroy(argv);
-            return EXEC_ERROR;
-        }
-        int xit;
-        if (!exec_builtin(argv, &cxt, &xit)) {
-            argv_destroy(argv);
-            if (xit)
-                return EXEC_EXIT;
+    cxt.command = command;
+    cxt.program = exec_get_program(command);
+    cxt.in_child = 0;
+    cxt.capture = 0;
+    cxt.profile = 0;
+    int ret = exec_block(&cxt, 0);
+    if (cxt.program != command_program(command))
+        program_destroy(cxt.program);
+    return ret;
+}
+
+/*!
+    \return the exit status of the last command run in the foreground
+*/
+int exec_last_status() {
+    return _exec_status;
+}
+
+/*!
+    \brief Set the exit status of the last command, e.g. for "exit n"
+*/
+void exec_set_status(int status) {
+    _exec_status = status;
+}
+
+/*!
+    \brief Evaluate the arguments of a simple command without running it
+    \param command Command to evaluate
+    \param argv argv_t to add the resulting arguments to
+    \return 0 on success
+    Command substitutions are run, redirections are evaluated but ignored.
+*/
+int exec_expand(command_t *command, argv_t *argv) {
+    if (!argv || command_is_pipechain(command) || command_is_list(command))
+        return 1;
+    exec_context_t cxt;
+    cxt.tasklist = 0;
+    cxt.command = 0;
+    cxt.program = exec_get_program(command);
+    cxt.in_child = 0;
+    cxt.capture = 0;
+    cxt.profile = 0;
+    exec_frame_t frame;
+    size_t mark = _exec_nprocesses;
+    int ret = exec_capture(&cxt, 0, &frame);
+    size_t i, n = ret == EXEC_OK ? argv_get_argc(frame.argv) : 0;
+    for (i = 0; i < n; ++i)
+        argv_add(argv, argv_get_argv(frame.argv)[i]);
+    exec_frame_release(&frame);
+    exec_reap_processes(mark);
+    if (cxt.program != command_program(command))
+        program_destroy(cxt.program);
+    return ret != EXEC_OK;
+}
+
+/*!
+    \brief Start a command given as an argument vector, without waiting for it
+    \param argv Command and its arguments, neither expanded nor split
+    \param in File descriptor to use as standard input, -1 to inherit
+    \param out File descriptor to use as standard output, -1 to inherit
+    \param tasklist Tasklist of the shell, if any
+    \return pid of the child process, -1 on failure
+    Builtins run in a child process too.
+*/
+pid_t exec_argv(argv_t *argv, int in, int out, task_list_t *tasklist) {
+    if (!argv || !argv_get_argc(argv))
+        return -1;
+    exec_context_t cxt;
+    cxt.tasklist = tasklist;
+    cxt.command = 0;
+    cxt.program = 0;
+    cxt.in_child = 0;
+    cxt.capture = 0;
+    cxt.profile = 0;
+    exec_frame_t frame;
+    frame.argv = argv;
+    frame.word = 0;
+    frame.in = 0;
+    frame.out = 0;
+    frame.in_data = 0;
+    frame.fds = 0;
+    frame.nfds = 0;
+    frame.assign = 0;
+    frame.status = 0;
+    return exec_start(&cxt, &frame, in, out);
+}
+
+/******************************************************************************/
+
+/*!
+    \internal
+    \brief Report the end of a background task
+    \param stat Status returned by wait4
+    \param usage Resources used by the task
+*/
+void exec_report_task(task_t *task, int stat, struct rusage *usage) {
+    const char *reason = "Exited";
+    if (WIFSIGNALED(stat))
+        reason = WCOREDUMP(stat) ? "Dumped" : "Killed";
+    long long tck = sysconf(_SC_CLK_TCK);
+    long long utime = usage->ru_utime.tv_sec * tck + usage->ru_utime.tv_usec * tck / 1000000;
+    long long stime = usage->ru_stime.tv_sec * tck + usage->ru_stime.tv_usec * tck / 1000000;
+    long long wall = task_get_elapsed_millis(task);
+    yas_readline_pre_signal();
+    fprintf(stderr,
+            "[%u] %s after %lli ms [usr=%llu, sys=%llu, cpu=%.2lf%%]\n",
+            task_get_pid(task),
+            reason,
+            wall,
+            utime,
+            stime,
+            wall > 0
+                ? ((double)(utime + stime) * 1000
+                    / (double)(wall * get_cpu_count() * tck))
+                : 0.0);
+    fflush(stderr);
+    yas_readline_post_signal();
+}
+
+/*!
+    \internal
+    \brief Start queued tasks, as long as the bg_limit option allows it
+*/
+void exec_dequeue(task_list_t *tasklist) {
+    int limit = option_get(OPTION_BG_LIMIT);
+    size_t index;
+    task_t *task;
+    while ((task = task_list_next_queued(tasklist, &index))
+            && (limit <= 0 || task_list_count_running(tasklist) < (size_t)limit)) {
+        pid_t pid;
+        size_t block;
+        exec_context_t cxt;
+        cxt.tasklist = tasklist;
+        cxt.command = task_get_block(task, &block);
+        cxt.program = command_program(cxt.command);
+        cxt.in_child = 0;
+        cxt.capture = 0;
+        cxt.profile = exec_background_profile();
+        if (cxt.command) {
+            /* a list or a pipeline */
+            pid = exec_background_start(&cxt, block);
         } else {
-            task_t *task = task_new();
-            pid_t pid = fork();
-            if (pid) {
-                if (command_is_background(command)) {
-                    task_set_pid(task, pid);
-                    task_set_argv(task, argv);
-                    task_list_add(cxt.tasklist, task);
-                    fprintf(stderr, "[%zu] %u\n", task_list_get_size(cxt.tasklist), pid);
-                } else {
-                    task_destroy(task);
-                    argv_destroy(argv);
-                    waitpid(pid, NULL, 0);
-                }
-            } else {
-                if (exec_setup_redir(command, &cxt))
-                    exit(1);
-                char **d = argv_get_argv(argv);
-                int errcode = execvp(*d, d);
-                fprintf(stderr, "Command not found: %s\n", *d);
-                exit(errcode);
-            }
+            exec_frame_t frame;
+            frame.argv = task_get_argv(task);
+            frame.word = 0;
+            frame.in = (char*)task_get_redir_in(task);
+            frame.in_data = task_redir_in_is_data(task);
+            frame.fds = task_get_fds(task, &frame.nfds);
+            frame.assign = task_get_assign(task);
+            frame.status = 0;
+            frame.out = (char*)task_get_redir_out(task);
+            pid = exec_start(&cxt, &frame, -1, -1);
+            /* the substitutions see the end of their pipes with the command */
+            task_set_fds(task, 0, 0);
+        }
+        if (pid <= 0) {
+            task_list_remove(tasklist, index);
+            task_destroy(task);
+            continue;
         }
+        task_list_start(tasklist, task, pid);
+        yas_readline_pre_signal();
+        fprintf(stderr, "[%zu] %u\n", index + 1, pid);
+        yas_readline_post_signal();
     }
-    return EXEC_OK;
+}
+
+/*!
+    \brief Reap the background tasks that finished and start queued ones
+    \param tasklist Tasklist of the shell
+*/
+void exec_update_tasks(task_list_t *tasklist) {
+    if (!tasklist || _exec_in_child)
+        return;
+    sigset_t chld, saved;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved);
+    int saved_errno = errno;
+    _exec_tasks_pending = 0;
+    size_t i = 0;
+    /* started tasks come first in the list, queued ones need no update */
+    while (i < task_list_count_running(tasklist)) {
+        task_t *task = task_list_get_task(tasklist, i);
+        pid_t pid = task_get_pid(task);
+        int stat;
+        struct rusage usage;
+        if (!task_is_running(task)) {
+            /* already reaped by list_tasks, which showed its status */
+            task_list_remove(tasklist, i);
+            task_destroy(task);
+            continue;
+        }
+        if (pid <= 0 || wait4(pid, &stat, WNOHANG, &usage) != pid) {
+            ++i;
+            continue;
+        }
+        task_list_remove(tasklist, i);
+        exec_report_task(task, stat, &usage);
+        task_destroy(task);
+    }
+    exec_dequeue(tasklist);
+    errno = saved_errno;
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+}
+
+/*!
+    \brief Handle SIGCHLD
+    \param tasklist Tasklist of the shell
+    The handler only records that tasks need an update : reaping, reporting
+    and starting queued tasks is done by exec_poll_tasks outside of it, e.g.
+    while waiting for a foreground child or for input.
+*/
+void exec_sigchld(task_list_t *tasklist) {
+    (void)tasklist;
+    _exec_tasks_pending = 1;
+}
+
+/*!
+    \brief Update background tasks if SIGCHLD was received since the last update
+    \param tasklist Tasklist of the shell
+*/
+void exec_poll_tasks(task_list_t *tasklist) {
+    if (_exec_tasks_pending)
+        exec_update_tasks(tasklist);
+}
+
+/*!
+    \brief Wait until no background task is queued
+    \param tasklist Tasklist of the shell
+    Called before the shell exits, so that queued tasks are not lost.
+*/
+void exec_drain(task_list_t *tasklist) {
+    if (!tasklist || _exec_in_child)
+        return;
+    sigset_t chld, saved;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &saved);
+    while (1) {
+        exec_update_tasks(tasklist);
+        if (!task_list_next_queued(tasklist, 0))
+            break;
+        /* the SIGCHLD handler runs here, a pending update is done on the next iteration */
+        sigsuspend(&saved);
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
 }
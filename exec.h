@@ -20,8 +20,11 @@
 */
 
 #include "command.h"
+#include "argv.h"
 #include "task.h"
 
+#include <sys/types.h>
+
 enum {
     EXEC_OK,
     EXEC_EXIT,
@@ -29,5 +32,14 @@ enum {
 };
 
 int exec_command(command_t *command, task_list_t *tasklist);
+int exec_last_status();
+void exec_set_status(int status);
+int exec_expand(command_t *command, argv_t *argv);
+pid_t exec_argv(argv_t *argv, int in, int out, task_list_t *tasklist);
+
+void exec_sigchld(task_list_t *tasklist);
+void exec_update_tasks(task_list_t *tasklist);
+void exec_poll_tasks(task_list_t *tasklist);
+void exec_drain(task_list_t *tasklist);
 
 #endif /* _EXEC_H_ */
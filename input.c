@@ -22,6 +22,11 @@
 #include "dstring.h"
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #ifdef YAS_USE_READLINE
 #include <readline/readline.h>
@@ -35,9 +40,9 @@ int yas_rl_getc(FILE *in) {
     return c;
 }
 #else
-#include <unistd.h>
 #include <stdlib.h>
 #include <termios.h>
+#include <poll.h>
 
 struct termios saved_attributes;
 
@@ -56,12 +61,144 @@ static void _yas_prompt_redisplay() {
 
 static int _yas_readline_busy = 0;
 
+/* called periodically while waiting for terminal input */
+static int (*_yas_idle_hook)() = 0;
+
+static int _yas_input_tty = -1;
+
+/*!
+    \internal
+    \brief Read-ahead buffer for non-terminal input
+    Unconsumed data lives in [start, end). It is moved back to the beginning of
+    the buffer before refilling and the buffer grows for lines that do not fit.
+*/
+static struct {
+    char *data;
+    size_t alloc;
+    size_t start;
+    size_t end;
+    int eof;
+    /* whether stdin is a regular file, -1 until the first read */
+    int seekable;
+    /* offset of a seekable stdin once moved back to the first unconsumed byte */
+    off_t offset;
+    /* identity of stdin, to recognize it once redirections are undone */
+    dev_t dev;
+    ino_t ino;
+} _yas_input = { 0, 0, 0, 0, 0, -1, 0, 0, 0 };
+
+enum {
+    YAS_INPUT_BLOCK = 65536
+};
+
+/*!
+    \internal
+    \brief Line input for non-terminal stdin (pipes, files...)
+    Input is read in large blocks and split into lines with memchr instead of
+    being read one byte at a time. When stdin is seekable, its offset is moved
+    back to the end of the line returned, so that the command sees the input
+    that follows it; the data read ahead is reused unless the command moved
+    the offset. A pipe cannot be moved back : the read builtin takes the data
+    read ahead through yas_input_read, other commands do not see it.
+*/
+static char* yas_read_buffered_line(int *eof) {
+    if (_yas_input.seekable == -1) {
+        struct stat st;
+        _yas_input.seekable = lseek(STDIN_FILENO, 0, SEEK_CUR) != -1;
+        if (!fstat(STDIN_FILENO, &st)) {
+            _yas_input.dev = st.st_dev;
+            _yas_input.ino = st.st_ino;
+        }
+    }
+    if (_yas_input.seekable && _yas_input.end > _yas_input.start) {
+        if (lseek(STDIN_FILENO, 0, SEEK_CUR) == _yas_input.offset) {
+            lseek(STDIN_FILENO, _yas_input.end - _yas_input.start, SEEK_CUR);
+        } else {
+            /* the last command consumed (part of) the input */
+            _yas_input.start = _yas_input.end = 0;
+            _yas_input.eof = 0;
+        }
+    }
+    while (1) {
+        const char *start = _yas_input.data + _yas_input.start;
+        size_t left = _yas_input.end - _yas_input.start;
+        const char *nl = left ? (const char*)memchr(start, '\n', left) : 0;
+        if (nl || (_yas_input.eof && left)) {
+            size_t n = nl ? (size_t)(nl - start) : left;
+            char *s = (char*)yas_malloc((n + 1) * sizeof(char));
+            memcpy(s, start, n);
+            s[n] = 0;
+            _yas_input.start += nl ? n + 1 : n;
+            left = _yas_input.end - _yas_input.start;
+            if (_yas_input.seekable && left) {
+                _yas_input.offset = lseek(STDIN_FILENO, -(off_t)left, SEEK_CUR);
+                if (_yas_input.offset == -1)
+                    _yas_input.seekable = 0;
+            }
+            return s;
+        } else if (_yas_input.eof) {
+            if (eof)
+                *eof = 1;
+            return 0;
+        }
+        /* make room for a whole block after pending data */
+        if (_yas_input.start) {
+            memmove(_yas_input.data, _yas_input.data + _yas_input.start, left);
+            _yas_input.start = 0;
+            _yas_input.end = left;
+        }
+        if (_yas_input.alloc - _yas_input.end < YAS_INPUT_BLOCK) {
+            _yas_input.alloc = _yas_input.alloc ? 2 * _yas_input.alloc : 4 * YAS_INPUT_BLOCK;
+            _yas_input.data = (char*)yas_realloc(_yas_input.data, _yas_input.alloc);
+        }
+        ssize_t n = read(STDIN_FILENO,
+                         _yas_input.data + _yas_input.end,
+                         _yas_input.alloc - _yas_input.end);
+        if (n > 0)
+            _yas_input.end += n;
+        else if (!n || errno != EINTR)
+            _yas_input.eof = 1;
+    }
+}
+
+/*!
+    \brief Read from the standard input, starting with the data the shell read
+    ahead from it
+    \return number of bytes read, 0 at the end of the input, -1 on error
+    A script piped to the shell may have been read past the current command,
+    which gets the following lines this way, e.g. with "read".
+*/
+ssize_t yas_input_read(char *buffer, size_t n) {
+    size_t left = _yas_input.end - _yas_input.start;
+    struct stat st;
+    if (left && !_yas_input.seekable && !fstat(STDIN_FILENO, &st)
+            && st.st_dev == _yas_input.dev && st.st_ino == _yas_input.ino) {
+        if (n > left)
+            n = left;
+        memcpy(buffer, _yas_input.data + _yas_input.start, n);
+        _yas_input.start += n;
+        return n;
+    }
+    return read(STDIN_FILENO, buffer, n);
+}
+
+/*!
+    \return Whether stdin is a terminal
+    When it is not, no prompt is displayed and input is not echoed back.
+*/
+int yas_input_is_tty() {
+    if (_yas_input_tty == -1)
+        _yas_input_tty = isatty(STDIN_FILENO);
+    return _yas_input_tty;
+}
+
 static void yas_readline_setup() {
     _yas_readline_busy = 1;
 #ifdef YAS_USE_READLINE
     /* Install EOF handler */
     _yas_readline_at_end = 0;
     rl_getc_function = yas_rl_getc;
+    rl_event_hook = _yas_idle_hook;
 #else
     /* If stdin is a not a terminal no specific setup.  */
     if (!isatty (STDIN_FILENO))
@@ -85,6 +222,7 @@ static void yas_readline_cleanup() {
 #ifdef YAS_USE_READLINE
     /* Remove EOF handler */
     rl_getc_function = rl_getc;
+    rl_event_hook = 0;
 #else
     if (!isatty (STDIN_FILENO))
         return;
@@ -95,6 +233,14 @@ static void yas_readline_cleanup() {
     _yas_readline_busy = 0;
 }
 
+/*!
+    \brief Set a function called about ten times a second while waiting for
+    terminal input, e.g. to handle events recorded by signal handlers
+*/
+void yas_readline_set_idle_hook(int (*hook)()) {
+    _yas_idle_hook = hook;
+}
+
 /*!
     \return Whether yas_readline is waiting for input
     Might be useful in signal handlers.
@@ -141,10 +287,13 @@ void yas_readline_post_signal() {
     \return A yas_malloc'ed string containing user input, null in case of error.
     This function is a wrapper around readline (when available) or a basic
     terminal input (or any other input methods that might be added in the future).
+    When stdin is not a terminal, \a prompt is ignored and input is read by blocks.
 */
 char* yas_readline(const char *prompt, int *eof) {
     if (eof)
         *eof = 0;
+    if (!yas_input_is_tty())
+        return yas_read_buffered_line(eof);
     yas_readline_setup();
 #ifdef YAS_USE_READLINE
     char *s = readline(prompt);
@@ -167,6 +316,11 @@ char* yas_readline(const char *prompt, int *eof) {
     fflush(stdout);
     while (1) {
         char c;
+        struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+        if (_yas_idle_hook && poll(&pfd, 1, 100) != 1) {
+            _yas_idle_hook();
+            continue;
+        }
         size_t n = read(STDIN_FILENO, &c, 1);
         if (n == 1) {
             if (c == 0x04 || c == '\n') {
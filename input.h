@@ -19,11 +19,17 @@
     \brief Definition of input abstraction layer.
 */
 
+#include <sys/types.h>
+
+int yas_input_is_tty();
+
 int yas_readline_is_busy();
 void yas_readline_pre_signal();
 void yas_readline_post_signal();
+void yas_readline_set_idle_hook(int (*hook)());
 
 char* yas_readline(const char *prompt, int *eof);
+ssize_t yas_input_read(char *buffer, size_t n);
 
 int yas_history_load(const char *filename);
 int yas_history_save(const char *filename);
@@ -20,8 +20,11 @@
 #include "dstring.h"
 #include "input.h"
 #include "command.h"
+#include "cache.h"
 #include "argv.h"
 #include "exec.h"
+#include "script.h"
+#include "check.h"
 #include "util.h"
 
 #include <stdio.h>
@@ -29,25 +32,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <signal.h>
-#include <time.h>
 #include <unistd.h>
-#include <sys/resource.h>
-
-static const char* sigchld_reason(int code) {
-    if (code == CLD_EXITED)
-        return "Exited";
-    else if (code == CLD_KILLED)
-        return "Killed";
-    else if (code == CLD_DUMPED)
-        return "Dumped";
-    else if (code == CLD_TRAPPED)
-        return "Trapped";
-    else if (code == CLD_STOPPED)
-        return "Stopped";
-    else if (code == CLD_CONTINUED)
-        return "Continued";
-    return "";
-}
 
 static task_list_t *tasklist = 0;
 
@@ -55,32 +40,16 @@ static void sigchld_handler(int sig, siginfo_t *info, void *context) {
     (void)context;
     if (sig != SIGCHLD || info->si_signo != SIGCHLD)
         return;
-    size_t i;
-    size_t n = task_list_get_size(tasklist);
-    for (i = 0; i < n; ++i) {
-        task_t *task = task_list_get_task(tasklist, i);
-        if (task_get_pid(task) == info->si_pid) {
-            task_list_remove(tasklist, i);
-            yas_readline_pre_signal();
-            long long utime = info->si_utime;
-            long long stime = info->si_stime;
-            long long wall = task_get_elapsed_millis(task);
-            fprintf(stderr,
-                    "[%u] %s after %lli ms [usr=%llu, sys=%llu, cpu=%.2lf%%]\n",
-                    info->si_pid,
-                    sigchld_reason(info->si_code),
-                    wall,
-                    utime,
-                    stime,
-                    wall > 0
-                        ? ((double)(utime + stime) * 1000
-                            / (double)(wall * get_cpu_count() * sysconf(_SC_CLK_TCK)))
-                        : 0.0);
-            fflush(stderr);
-            yas_readline_post_signal();
-            break;
-        }
-    }
+    exec_sigchld(tasklist);
+}
+
+/*!
+    \internal
+    \brief Report background tasks that finished while waiting for input
+*/
+static int idle_hook() {
+    exec_poll_tasks(tasklist);
+    return 0;
 }
 
 static void install_sigchld_handler() {
@@ -92,21 +61,6 @@ static void install_sigchld_handler() {
     }
 }
 
-/*!
-    \brief Check for trivial command lines
-    trivial = empty line, line made of whitspaces, comments
-*/
-int is_nontrivial(const char *s) {
-    if (!s)
-        return 0;
-    while (*s) {
-        if (!isspace(*s))
-            return *s != '#';
-        ++s;
-    }
-    return 0;
-}
-
 /*!
     \internal
     \brief Build the prompt string
@@ -131,32 +85,71 @@ string_t* get_prompt(string_t *s) {
     return s;
 }
 
-int main(int argc, char **argv) {
-    (void) argc;
-    (void) argv;
-    
-    tasklist = task_list_new();
-    install_sigchld_handler();
-    
-    string_t *history = string_from_cstr_own(get_homedir());
-    string_append_cstr(history, ".yas_history");
-    yas_history_load(string_get_cstr(history));
+/*!
+    \internal
+    \brief Read the bodies of the here-documents of an interactive command line
+    \param line First line of the command
+    \param error Parse error of the incomplete command line
+    \return the parsed command, 0 on error
+    Lines are read with a "> " prompt until every here-document is terminated.
+*/
+command_t* read_heredocs(const char *line, command_error_t *error, int *eof) {
+    string_t *text = string_from_cstr(line);
+    command_t *command = 0;
+    while (!command && error->type == ERRTYPE_INCOMPLETE_HEREDOC && !*eof) {
+        char *next = yas_readline("> ", eof);
+        if (!next)
+            break;
+        size_t next_sz = strlen(next);
+        string_append_char(text, '\n');
+        string_append_cstrn(text, next, next_sz);
+        if (command_heredoc_ends(error, next, next_sz))
+            command = command_cache_lookup(string_get_cstr(text),
+                                           string_get_length(text),
+                                           error);
+        yas_free(next);
+    }
+    string_destroy(text);
+    return command;
+}
+
+/*!
+    \internal
+    \brief Interactive read-eval loop
+*/
+int run_interactive() {
+    /* no prompt nor history when reading commands from a pipe or a file */
+    int tty = yas_input_is_tty();
+    string_t *history = 0;
+    if (tty) {
+        history = string_from_cstr_own(get_homedir());
+        string_append_cstr(history, ".yas_history");
+        yas_history_load(string_get_cstr(history));
+    }
     
     int eof = 0;
     string_t *prompt = 0;
     while (!eof) {
-        prompt = get_prompt(prompt);
+        /* report background tasks that finished while a command was running */
+        exec_poll_tasks(tasklist);
+        if (tty)
+            prompt = get_prompt(prompt);
         char *line = yas_readline(string_get_cstr(prompt), &eof);
-        if (is_nontrivial(line)) {
-            size_t line_sz = strlen(line);
-            command_t *command = command_create(line, line_sz);
+        size_t line_sz = line ? strlen(line) : 0;
+        if (!is_nontrivial(line, line_sz)) {
+            yas_free(line);
+        } else {
+            command_error_t error;
+            command_t *command = command_cache_lookup(line, line_sz, &error);
+            if (!command && error.type == ERRTYPE_INCOMPLETE_HEREDOC)
+                command = read_heredocs(line, &error, &eof);
             yas_free(line);
             if (!command) {
-                size_t i, n = command_error_position() + string_get_length(prompt);
+                size_t i, n = error.position + string_get_length(prompt);
                 for (i = 0; i < n; ++i) 
                     fprintf(stderr, " ");
-                fprintf(stderr, "^\nsyntax error @ %zu : ", command_error_position());
-                fprintf(stderr, "%s\n", command_error_string());
+                fprintf(stderr, "^\nsyntax error @ %zu : ", error.position);
+                fprintf(stderr, "%s\n", command_error_string(&error));
             } else {
                 /* command_inspect(command, 0); */
                 int ret = exec_command(command, tasklist);
@@ -166,6 +159,97 @@ int main(int argc, char **argv) {
             }
         }
     }
-    yas_history_save(string_get_cstr(history));
-    return 0;
+    if (history)
+        yas_history_save(string_get_cstr(history));
+    return exec_last_status();
+}
+
+/*!
+    \internal
+    \brief Non-interactive execution of a script
+    \param script Script to execute
+    \param name Name of the script, for error reporting
+    \return exit status of the shell : the one of the last command, or 2 on
+    syntax error
+    Command lines are parsed in place from the script buffer. No prompt is
+    built and neither readline nor history are involved.
+*/
+int run_script(script_t *script, const char *name) {
+    const char *line;
+    size_t line_sz;
+    while (script_next_line(script, &line, &line_sz)) {
+        if (!is_nontrivial(line, line_sz))
+            continue;
+        command_error_t error;
+        command_t *command = command_cache_lookup(line, line_sz, &error);
+        while (!command && error.type == ERRTYPE_INCOMPLETE_HEREDOC) {
+            /* here-document bodies follow the command line in the buffer */
+            const char *next;
+            size_t next_sz;
+            if (!script_next_line(script, &next, &next_sz))
+                break;
+            line_sz = next + next_sz - line;
+            if (command_heredoc_ends(&error, next, next_sz))
+                command = command_cache_lookup(line, line_sz, &error);
+        }
+        if (!command) {
+            fprintf(stderr, "%s:%zu: syntax error @ %zu : %s\n",
+                    name,
+                    script_line_number(script),
+                    error.position,
+                    command_error_string(&error));
+            return 2;
+        }
+        int ret = exec_command(command, tasklist);
+        command_destroy(command);
+        if (ret == EXEC_EXIT)
+            break;
+    }
+    return exec_last_status();
+}
+
+static void usage() {
+    fprintf(stderr, "usage: yas [-c command | -n script... | script]\n");
+}
+
+int main(int argc, char **argv) {
+    tasklist = task_list_new();
+    install_sigchld_handler();
+    yas_readline_set_idle_hook(idle_hook);
+    
+    if (argc < 2) {
+        int ret = run_interactive();
+        exec_drain(tasklist);
+        return ret;
+    }
+    
+    script_t *script = 0;
+    const char *name = argv[1];
+    if (!strcmp(argv[1], "-c")) {
+        if (argc < 3) {
+            usage();
+            return 2;
+        }
+        name = "-c";
+        script = script_from_string(argv[2], strlen(argv[2]));
+    } else if (!strcmp(argv[1], "-n")) {
+        if (argc < 3) {
+            usage();
+            return 2;
+        }
+        return check_scripts(argc - 2, argv + 2);
+    } else if (argv[1][0] == '-') {
+        usage();
+        return 2;
+    } else {
+        script = script_open(argv[1]);
+        if (!script) {
+            fprintf(stderr, "yas: unable to read %s\n", argv[1]);
+            return 127;
+        }
+    }
+    int ret = run_script(script, name);
+    script_close(script);
+    exec_drain(tasklist);
+    return ret;
 }
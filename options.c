@@ -0,0 +1,84 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "options.h"
+
+/*!
+    \file options.c
+    \brief Implementation of shell options
+*/
+
+#include <string.h>
+
+/*!
+    \internal
+    \brief Description of a shell option
+*/
+typedef struct {
+    const char *name;
+    int boolean;
+    int value;
+} option_t;
+
+static option_t _options[OPTION_COUNT] = {
+    { "cache",           1, 1  },
+    { "cache_size",      0, 64 },
+    { "spawn",           1, 1  },
+    { "hash",            1, 1  },
+    { "pipe_size",       0, 0  },
+    { "bg_limit",        0, 0  },
+    { "bg_low_priority", 1, 0  },
+    { "pipefail",        1, 0  }
+};
+
+/*!
+    \return the current value of an option, 0 for unknown options
+*/
+int option_get(int id) {
+    return id >= 0 && id < OPTION_COUNT ? _options[id].value : 0;
+}
+
+/*!
+    \brief Set the value of an option
+    Boolean options are normalized to 0 or 1.
+*/
+void option_set(int id, int value) {
+    if (id < 0 || id >= OPTION_COUNT)
+        return;
+    _options[id].value = _options[id].boolean ? !!value : value;
+}
+
+/*!
+    \return the identifier of the option named \a name, -1 if there is none
+*/
+int option_find(const char *name) {
+    int i;
+    for (i = 0; name && i < OPTION_COUNT; ++i)
+        if (!strcmp(_options[i].name, name))
+            return i;
+    return -1;
+}
+
+/*!
+    \return the name of an option
+*/
+const char* option_name(int id) {
+    return id >= 0 && id < OPTION_COUNT ? _options[id].name : 0;
+}
+
+/*!
+    \return whether an option is a boolean flag rather than a numeric value
+*/
+int option_is_boolean(int id) {
+    return id >= 0 && id < OPTION_COUNT ? _options[id].boolean : 0;
+}
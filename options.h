@@ -0,0 +1,44 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+/*!
+    \file options.h
+    \brief Definition of shell options
+*/
+
+/*!
+    \brief Identifiers of shell options
+*/
+enum option_id {
+    OPTION_CACHE,
+    OPTION_CACHE_SIZE,
+    OPTION_SPAWN,
+    OPTION_HASH,
+    OPTION_PIPE_SIZE,
+    OPTION_BG_LIMIT,
+    OPTION_BG_LOW_PRIORITY,
+    OPTION_PIPEFAIL,
+    OPTION_COUNT
+};
+
+int option_get(int id);
+void option_set(int id, int value);
+
+int option_find(const char *name);
+const char* option_name(int id);
+int option_is_boolean(int id);
+
+#endif /* _OPTIONS_H_ */
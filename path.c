@@ -0,0 +1,310 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "path.h"
+
+/*!
+    \file path.c
+    \brief Implementation of the command path hash table
+
+    Command names are resolved against $PATH once and the result is kept in
+    a hash table, including negative results for commands that could not be
+    found. The whole table is dropped whenever $PATH changes. Entries for
+    files that disappeared are dropped by the caller, with path_forget, when
+    the command fails to start. Negative entries remember the modification
+    times of the directories of $PATH and are searched again once any of
+    them changed, e.g. when the command is installed. Lookups in relative
+    directories of $PATH depend on the working directory and are not
+    remembered.
+    The table is bypassed when the hash shell option is off.
+*/
+
+#include "memory.h"
+#include "options.h"
+#include "var.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*!
+    \internal
+    \brief Resolved command name
+*/
+typedef struct _path_entry {
+    unsigned long long hash;
+    char *name;
+    char *path;     /*!< 0 for commands that could not be found */
+    unsigned long long stamp;   /*!< path_stamp of $PATH, for negative entries */
+    unsigned int hits;
+    struct _path_entry *chain;
+} path_entry_t;
+
+static path_entry_t **_path_buckets = 0;
+static size_t _path_bucket_count = 0;
+static size_t _path_size = 0;
+static char *_path_env = 0;
+static char *_path_uncached = 0;
+static unsigned long long _path_hits = 0;
+static unsigned long long _path_misses = 0;
+
+/*!
+    \internal
+    \brief FNV-1a hash of a command name
+*/
+static unsigned long long path_hash(const char *name) {
+    unsigned long long h = 14695981039346656037ULL;
+    for (; *name; ++name) {
+        h ^= (unsigned char)*name;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void path_entry_destroy(path_entry_t *e) {
+    yas_free(e->name);
+    yas_free(e->path);
+    yas_free(e);
+}
+
+/*!
+    \internal
+    \brief Make sure the hash table is large enough for one more entry
+*/
+static void path_reserve() {
+    if (2 * (_path_size + 1) <= _path_bucket_count)
+        return;
+    size_t i, n = _path_bucket_count ? 2 * _path_bucket_count : 64;
+    path_entry_t **buckets = (path_entry_t**)yas_malloc(n * sizeof(path_entry_t*));
+    memset(buckets, 0, n * sizeof(path_entry_t*));
+    for (i = 0; i < _path_bucket_count; ++i) {
+        path_entry_t *e = _path_buckets[i];
+        while (e) {
+            path_entry_t *next = e->chain;
+            e->chain = buckets[e->hash & (n - 1)];
+            buckets[e->hash & (n - 1)] = e;
+            e = next;
+        }
+    }
+    yas_free(_path_buckets);
+    _path_buckets = buckets;
+    _path_bucket_count = n;
+}
+
+/*!
+    \internal
+    \brief Search $PATH for an executable file
+    \param name Command name
+    \param env Value of $PATH
+    \param cacheable set to 0 if the result depends on the working directory
+    \return the yas_malloc'ed path of the command, 0 if there is none
+*/
+static char* path_search(const char *name, const char *env, int *cacheable) {
+    size_t n = strlen(name);
+    *cacheable = 1;
+    while (1) {
+        const char *end = strchr(env, ':');
+        size_t dn = end ? (size_t)(end - env) : strlen(env);
+        if (!dn || *env != '/')
+            *cacheable = 0;
+        char *path = (char*)yas_malloc(dn + n + 3);
+        if (dn) {
+            memcpy(path, env, dn);
+        } else {
+            /* empty entries stand for the working directory */
+            path[0] = '.';
+            dn = 1;
+        }
+        path[dn] = '/';
+        memcpy(path + dn + 1, name, n + 1);
+        struct stat st;
+        if (!stat(path, &st) && S_ISREG(st.st_mode) && !access(path, X_OK))
+            return path;
+        yas_free(path);
+        if (!end)
+            break;
+        env = end + 1;
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Hash of the modification times of the directories of $PATH
+    Missing directories count as well, so that creating one is noticed.
+*/
+static unsigned long long path_stamp(const char *env) {
+    char dir[PATH_MAX];
+    unsigned long long h = 14695981039346656037ULL;
+    while (1) {
+        const char *end = strchr(env, ':');
+        size_t dn = end ? (size_t)(end - env) : strlen(env);
+        struct stat st;
+        memset(&st, 0, sizeof(struct stat));
+        if (dn < sizeof(dir)) {
+            memcpy(dir, env, dn);
+            dir[dn] = 0;
+            stat(dir, &st);
+        }
+        h = (h ^ (unsigned long long)st.st_mtim.tv_sec) * 1099511628211ULL;
+        h = (h ^ (unsigned long long)st.st_mtim.tv_nsec) * 1099511628211ULL;
+        h = (h ^ (unsigned long long)st.st_ino) * 1099511628211ULL;
+        if (!end)
+            break;
+        env = end + 1;
+    }
+    return h;
+}
+
+/*!
+    \brief Resolve a command name to the path of an executable file
+    \param name Command name
+    \return path of the command, 0 if it cannot be found
+    Names containing a slash are returned unchanged. The returned string is
+    only valid until the next call to a path_* function.
+*/
+const char* path_lookup(const char *name) {
+    if (!name || !*name)
+        return 0;
+    if (strchr(name, '/'))
+        return name;
+    const char *env = var_get("PATH");
+    if (!env)
+        env = "/bin:/usr/bin";
+    if (!_path_env || strcmp(_path_env, env)) {
+        path_clear();
+        yas_free(_path_env);
+        _path_env = (char*)yas_malloc(strlen(env) + 1);
+        strcpy(_path_env, env);
+    }
+    
+    int enabled = option_get(OPTION_HASH);
+    unsigned long long h = path_hash(name);
+    path_entry_t *e = _path_bucket_count
+                    ? _path_buckets[h & (_path_bucket_count - 1)]
+                    : 0;
+    while (enabled && e && !(e->hash == h && !strcmp(e->name, name)))
+        e = e->chain;
+    if (enabled && e && !e->path && e->stamp != path_stamp(env)) {
+        /* a directory of $PATH changed since the command was not found */
+        path_forget(name);
+        e = 0;
+    }
+    if (enabled && e) {
+        ++_path_hits;
+        ++e->hits;
+        return e->path;
+    }
+    
+    ++_path_misses;
+    int cacheable;
+    /* taken first, so that a command installed during the search is found next time */
+    unsigned long long stamp = path_stamp(env);
+    char *path = path_search(name, env, &cacheable);
+    if (!enabled || !cacheable) {
+        yas_free(_path_uncached);
+        _path_uncached = path;
+        return path;
+    }
+    path_reserve();
+    e = (path_entry_t*)yas_malloc(sizeof(path_entry_t));
+    e->hash = h;
+    e->name = (char*)yas_malloc(strlen(name) + 1);
+    strcpy(e->name, name);
+    e->path = path;
+    e->stamp = stamp;
+    e->hits = 1;
+    e->chain = _path_buckets[h & (_path_bucket_count - 1)];
+    _path_buckets[h & (_path_bucket_count - 1)] = e;
+    ++_path_size;
+    return path;
+}
+
+/*!
+    \brief Drop the entry of a command, if any
+    Meant to be called when the cached file of a command disappeared.
+*/
+void path_forget(const char *name) {
+    if (!_path_bucket_count || !name)
+        return;
+    unsigned long long h = path_hash(name);
+    path_entry_t **b = &_path_buckets[h & (_path_bucket_count - 1)];
+    while (*b && !((*b)->hash == h && !strcmp((*b)->name, name)))
+        b = &(*b)->chain;
+    if (*b) {
+        path_entry_t *e = *b;
+        *b = e->chain;
+        path_entry_destroy(e);
+        --_path_size;
+    }
+}
+
+/*!
+    \brief Drop all entries
+*/
+void path_clear() {
+    size_t i;
+    for (i = 0; i < _path_bucket_count; ++i) {
+        while (_path_buckets[i]) {
+            path_entry_t *e = _path_buckets[i];
+            _path_buckets[i] = e->chain;
+            path_entry_destroy(e);
+        }
+    }
+    _path_size = 0;
+}
+
+/*!
+    \brief Print the content of the table on stdout
+    One line per command : number of hits and resolved path, or name of the
+    command for negative entries.
+*/
+void path_inspect() {
+    size_t i;
+    if (!_path_size)
+        return;
+    fprintf(stdout, "hits\tcommand\n");
+    for (i = 0; i < _path_bucket_count; ++i) {
+        path_entry_t *e;
+        for (e = _path_buckets[i]; e; e = e->chain) {
+            if (e->path)
+                fprintf(stdout, "%4u\t%s\n", e->hits, e->path);
+            else
+                fprintf(stdout, "%4u\t%s (not found)\n", e->hits, e->name);
+        }
+    }
+}
+
+/*!
+    \return the number of commands in the table
+*/
+size_t path_size() {
+    return _path_size;
+}
+
+/*!
+    \return the number of lookups served from the table
+*/
+unsigned long long path_hits() {
+    return _path_hits;
+}
+
+/*!
+    \return the number of lookups that required a search of $PATH
+*/
+unsigned long long path_misses() {
+    return _path_misses;
+}
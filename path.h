@@ -0,0 +1,33 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _PATH_H_
+#define _PATH_H_
+
+/*!
+    \file path.h
+    \brief Definition of the command path hash table
+*/
+
+#include <stddef.h>
+
+const char* path_lookup(const char *name);
+void path_forget(const char *name);
+void path_clear();
+void path_inspect();
+
+size_t path_size();
+unsigned long long path_hits();
+unsigned long long path_misses();
+
+#endif /* _PATH_H_ */
@@ -0,0 +1,314 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "program.h"
+
+/*!
+    \file program.c
+    \brief Implementation of program_t
+*/
+
+#include "memory.h"
+#include "var.h"
+
+#include <stdio.h>
+#include <string.h>
+
+struct _program {
+    size_t ninstr;
+    size_t pool_size;
+    instr_t *code;
+    char *pool;
+};
+
+/*!
+    \internal
+    \brief Compiler state
+*/
+typedef struct {
+    instr_t *code;
+    size_t ninstr;
+    size_t acode;
+    char *pool;
+    size_t pool_size;
+    size_t apool;
+    /* nested commands waiting to be compiled, with the instruction to patch */
+    command_t **pending;
+    size_t *patch;
+    size_t npending;
+    size_t apending;
+} compiler_t;
+
+static size_t compiler_emit(compiler_t *c, int op, int flags, unsigned int a) {
+    if (c->ninstr == c->acode) {
+        c->acode = c->acode ? 2 * c->acode : 32;
+        c->code = (instr_t*)yas_realloc(c->code, c->acode * sizeof(instr_t));
+    }
+    instr_t *i = c->code + c->ninstr;
+    i->op = op;
+    i->flags = flags;
+    i->a = a;
+    return c->ninstr++;
+}
+
+static unsigned int compiler_string(compiler_t *c, const char *s) {
+    size_t n = strlen(s) + 1;
+    if (c->apool - c->pool_size < n) {
+        while (c->apool - c->pool_size < n)
+            c->apool = c->apool ? 2 * c->apool : 256;
+        c->pool = (char*)yas_realloc(c->pool, c->apool);
+    }
+    unsigned int offset = c->pool_size;
+    memcpy(c->pool + offset, s, n);
+    c->pool_size += n;
+    return offset;
+}
+
+/*!
+    \internal
+    \brief Emit an instruction referring to a block that is yet to be compiled
+*/
+static void compiler_defer(compiler_t *c, int op, int flags, command_t *command) {
+    if (c->npending == c->apending) {
+        c->apending = c->apending ? 2 * c->apending : 8;
+        c->pending = (command_t**)yas_realloc(c->pending, c->apending * sizeof(command_t*));
+        c->patch = (size_t*)yas_realloc(c->patch, c->apending * sizeof(size_t));
+    }
+    c->pending[c->npending] = command;
+    c->patch[c->npending] = compiler_emit(c, op, flags, 0);
+    ++c->npending;
+}
+
+/*!
+    \internal
+    \brief Emit the instructions appending the value of an argument to the current word
+    \param flags OPFLAG_BACKGROUND if the word belongs to a background command
+*/
+static void compile_word(compiler_t *c, argument_t *argument, int flags) {
+    switch (argument_type(argument)) {
+        case ARGTYPE_STRING:
+            compiler_emit(c, OP_LITERAL, 0, compiler_string(c, argument_get_string(argument)));
+            break;
+        case ARGTYPE_VARIABLE:
+            compiler_emit(c, OP_VARIABLE, 0, compiler_string(c, argument_get_variable(argument)));
+            break;
+        case ARGTYPE_ARITH:
+            compiler_emit(c, OP_ARITH, 0, compiler_string(c, argument_get_expression(argument)));
+            break;
+        case ARGTYPE_COMMAND:
+            compiler_defer(c, OP_SUBST, 0, argument_get_command(argument));
+            break;
+        case ARGTYPE_PROCESS_IN:
+        case ARGTYPE_PROCESS_OUT:
+            if (argument_type(argument) == ARGTYPE_PROCESS_OUT)
+                flags |= OPFLAG_PROCESS_OUT;
+            compiler_defer(c, OP_PROCESS, flags, argument_get_command(argument));
+            break;
+        case ARGTYPE_CAT:
+        {
+            argument_t **l = argument_get_arguments(argument);
+            while (l && *l)
+                compile_word(c, *(l++), flags);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/*!
+    \internal
+    \return whether an argument is a variable assignment : an unquoted
+    "name=" followed by anything
+*/
+static int compile_is_assignment(argument_t *argument) {
+    if (argument_type(argument) == ARGTYPE_CAT)
+        argument = argument_get_arguments(argument)[0];
+    if (argument_type(argument) != ARGTYPE_STRING || (argument_flags(argument) & ARGTYPE_QUOTED))
+        return 0;
+    const char *s = argument_get_string(argument);
+    size_t n = var_name_length(s);
+    return n && s[n] == '=';
+}
+
+/*!
+    \internal
+    \return whether an argument names a builtin whose assignment arguments are
+    not field-split, e.g. export
+*/
+static int compile_is_declaration(argument_t *argument) {
+    if (argument_type(argument) != ARGTYPE_STRING)
+        return 0;
+    const char *s = argument_get_string(argument);
+    return !strcmp(s, "export") || !strcmp(s, "readonly");
+}
+
+/*!
+    \internal
+    \brief Flags of an OP_STAGE instruction
+    The size of the output pipe is rounded up to a power of two, which the
+    kernel does anyway.
+*/
+static int compile_stage_flags(command_t *stage) {
+    int flags = 0;
+    size_t size = command_pipe_size(stage);
+    if (size) {
+        int log2 = 0;
+        while (log2 < 40 && ((size_t)1 << log2) < size)
+            ++log2;
+        flags |= log2 << OPFLAG_PIPE_SIZE_SHIFT;
+    }
+    return flags;
+}
+
+/*!
+    \internal
+    \brief Compile a command_t into a block
+    \param foreground Whether the block is the body of an OP_BACKGROUND, which
+    runs in the foreground of a copy of the shell
+*/
+static void compile_block(compiler_t *c, command_t *command, int foreground) {
+    const size_t n = command_argc(command);
+    argument_t **d = command_argv(command);
+    size_t i;
+    if (!foreground && command_is_background(command)
+            && (command_is_list(command) || command_is_pipechain(command))) {
+        compiler_emit(c, OP_LITERAL, 0, compiler_string(c, command_text(command)));
+        compiler_defer(c, OP_BACKGROUND, 0, command);
+    } else if (command_is_list(command)) {
+        compiler_emit(c, OP_LIST, 0, n);
+        for (i = 0; i < n; ++i) {
+            command_t *item = argument_get_command(d[i]);
+            int op = command_list_op(item);
+            compiler_defer(c, OP_ITEM, op == LIST_AND ? OPFLAG_AND : op == LIST_OR ? OPFLAG_OR : 0, item);
+        }
+    } else if (command_is_pipechain(command)) {
+        compiler_emit(c, OP_PIPE, 0, n);
+        for (i = 0; i < n; ++i) {
+            command_t *stage = argument_get_command(d[i]);
+            compiler_defer(c, OP_STAGE, compile_stage_flags(stage), stage);
+        }
+    } else {
+        int bg = command_is_background(command) ? OPFLAG_BACKGROUND : 0;
+        /* leading assignments, e.g. "a=1 b=2 cmd" */
+        size_t nassign = 0;
+        while (nassign < n && compile_is_assignment(d[nassign]))
+            ++nassign;
+        int declaration = nassign < n && compile_is_declaration(d[nassign]);
+        /* without a command, "a=1 b=$a" sets b to the new value of a */
+        int now = nassign == n && !bg ? OPFLAG_ASSIGN_NOW : 0;
+        for (i = 0; i < n; ++i) {
+            int op = OP_SPLIT, flags = 0;
+            if (i < nassign) {
+                op = OP_ASSIGN;
+                flags = now;
+            }
+            else if ((argument_flags(d[i]) & ARGTYPE_QUOTED)
+                    || (declaration && compile_is_assignment(d[i])))
+                op = OP_FIELD;
+            compile_word(c, d[i], bg);
+            compiler_emit(c, op, flags, 0);
+        }
+        if (command_redir_in(command)) {
+            compile_word(c, command_redir_in(command), bg);
+            compiler_emit(c, command_redir_in_is_data(command) ? OP_REDIR_DATA : OP_REDIR_IN, 0, 0);
+        }
+        if (command_redir_out(command)) {
+            compile_word(c, command_redir_out(command), bg);
+            compiler_emit(c, OP_REDIR_OUT, 0, 0);
+        }
+        compiler_emit(c, OP_SPAWN, bg, 0);
+    }
+    compiler_emit(c, OP_END, 0, 0);
+}
+
+/*!
+    \brief Compile a command_t into a program_t
+    \param command Parsed command line
+    \return a new program_t
+*/
+program_t* program_compile(command_t *command) {
+    compiler_t c;
+    memset(&c, 0, sizeof(compiler_t));
+    compile_block(&c, command, 0);
+    /* nested commands are compiled breadth-first, each into its own block */
+    size_t next = 0;
+    while (next < c.npending) {
+        c.code[c.patch[next]].a = c.ninstr;
+        compile_block(&c, c.pending[next], c.code[c.patch[next]].op == OP_BACKGROUND);
+        ++next;
+    }
+    
+    size_t code_size = c.ninstr * sizeof(instr_t);
+    program_t *program = (program_t*)yas_malloc(sizeof(program_t) + code_size + c.pool_size);
+    program->ninstr = c.ninstr;
+    program->pool_size = c.pool_size;
+    program->code = (instr_t*)(program + 1);
+    program->pool = (char*)program->code + code_size;
+    memcpy(program->code, c.code, code_size);
+    if (c.pool_size)
+        memcpy(program->pool, c.pool, c.pool_size);
+    
+    yas_free(c.code);
+    yas_free(c.pool);
+    yas_free(c.pending);
+    yas_free(c.patch);
+    return program;
+}
+
+/*!
+    \brief Destroy a program_t
+*/
+void program_destroy(program_t *program) {
+    yas_free(program);
+}
+
+/*!
+    \return the instructions of a program_t
+*/
+const instr_t* program_code(program_t *program) {
+    return program ? program->code : 0;
+}
+
+/*!
+    \return the string stored at \a offset in the string pool of a program_t
+*/
+const char* program_string(program_t *program, unsigned int offset) {
+    return program && offset < program->pool_size ? program->pool + offset : 0;
+}
+
+/*!
+    \brief Print the content of a program_t for debugging purpose
+*/
+void program_inspect(program_t *program) {
+    static const char *names[] = {
+        "END", "LITERAL", "VARIABLE", "SUBST", "FIELD", "SPLIT",
+        "REDIR_IN", "REDIR_OUT", "REDIR_DATA", "SPAWN", "PIPE", "STAGE",
+        "LIST", "ITEM", "PROCESS", "ASSIGN",
+        "ARITH", "BACKGROUND"
+    };
+    if (!program)
+        return;
+    size_t i;
+    for (i = 0; i < program->ninstr; ++i) {
+        const instr_t *instr = program->code + i;
+        fprintf(stdout, "%4zu  %-10s %x", i, names[instr->op], instr->flags);
+        if (instr->op == OP_LITERAL || instr->op == OP_VARIABLE || instr->op == OP_ARITH)
+            fprintf(stdout, " \"%s\"", program->pool + instr->a);
+        else if (instr->op == OP_SUBST || instr->op == OP_PIPE || instr->op == OP_STAGE
+                || instr->op == OP_LIST || instr->op == OP_ITEM || instr->op == OP_PROCESS
+                || instr->op == OP_BACKGROUND)
+            fprintf(stdout, " %u", instr->a);
+        fputc('\n', stdout);
+    }
+}
@@ -0,0 +1,91 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _PROGRAM_H_
+#define _PROGRAM_H_
+
+/*!
+    \file program.h
+    \brief Definition of program_t
+*/
+
+#include "command.h"
+
+/*!
+    \brief Compiled representation of a command_t
+    A program is a flat sequence of instructions stored, along with the
+    strings they refer to, in a single contiguous buffer. It is made of blocks
+    terminated by OP_END : block 0 is the command line itself, other blocks
+    correspond to nested commands (list elements, pipeline stages, command
+    substitutions, background lists and pipelines).
+    
+    Words are built by appending to an implicit accumulator (OP_LITERAL,
+    OP_VARIABLE, OP_SUBST, OP_PROCESS, OP_ARITH) which is then consumed by OP_FIELD, OP_SPLIT,
+    OP_ASSIGN or a redirection. OP_SPAWN runs the resulting argument vector.
+*/
+typedef struct _program program_t;
+
+enum opcode {
+    OP_END,         /*!< end of block */
+    OP_LITERAL,     /*!< append string a to the current word */
+    OP_VARIABLE,    /*!< append the value of variable a to the current word */
+    OP_SUBST,       /*!< append the output of block a to the current word */
+    OP_FIELD,       /*!< add the current word to argv as is */
+    OP_SPLIT,       /*!< field-split and glob-expand the current word into argv */
+    OP_REDIR_IN,    /*!< read input from the file named by the current word */
+    OP_REDIR_OUT,   /*!< write output to the file named by the current word */
+    OP_REDIR_DATA,  /*!< read input from the content of the current word */
+    OP_SPAWN,       /*!< run argv with the current redirections */
+    OP_PIPE,        /*!< run a pipeline of the a OP_STAGE that follow */
+    OP_STAGE,       /*!< pipeline stage running block a */
+    OP_LIST,        /*!< run the a OP_ITEM that follow, in order */
+    OP_ITEM,        /*!< list element running block a */
+    OP_PROCESS,     /*!< append a /dev/fd path connected to block a, run concurrently */
+    OP_ASSIGN,      /*!< record the current word as a "name=value" assignment */
+    OP_ARITH,       /*!< append the value of arithmetic expression a to the current word */
+    OP_BACKGROUND   /*!< run block a in the background, described by the current word */
+};
+
+enum opcode_flags {
+    /*! OP_SPAWN, OP_PROCESS : the command is run in the background */
+    OPFLAG_BACKGROUND = 1,
+    /*! OP_ITEM : only run if the exit status of the previous element is 0 */
+    OPFLAG_AND = 2,
+    /*! OP_ITEM : only run if the exit status of the previous element is not 0 */
+    OPFLAG_OR = 4,
+    /*! OP_PROCESS : the path is written to by the command, >(...) */
+    OPFLAG_PROCESS_OUT = 8,
+    /*! OP_ASSIGN : set the variable right away, the command has no arguments */
+    OPFLAG_ASSIGN_NOW = 16,
+    /*! OP_STAGE : base 2 logarithm of the size of the output pipe, 0 for the default */
+    OPFLAG_PIPE_SIZE_SHIFT = 8,
+    OPFLAG_PIPE_SIZE_MASK = 0x3f00
+};
+
+/*!
+    \brief A single instruction of a program_t
+*/
+typedef struct {
+    unsigned short op;
+    unsigned short flags;
+    unsigned int a;
+} instr_t;
+
+program_t* program_compile(command_t *command);
+void program_destroy(program_t *program);
+void program_inspect(program_t *program);
+
+const instr_t* program_code(program_t *program);
+const char* program_string(program_t *program, unsigned int offset);
+
+#endif /* _PROGRAM_H_ */
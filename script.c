@@ -0,0 +1,156 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "script.h"
+
+/*!
+    \file script.c
+    \brief Implementation of script_t
+*/
+
+#include "memory.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct _script {
+    const char *data;
+    size_t size;
+    size_t position;
+    size_t line;
+    int mapped;
+    int owned;
+};
+
+/*!
+    \internal
+    \brief Read the whole content of a file descriptor into a yas_malloc'ed buffer
+    Used for inputs that cannot be memory-mapped (pipes, character devices...)
+*/
+static char* script_read_all(int fd, size_t *sz) {
+    size_t alloc = 65536, size = 0;
+    char *buffer = (char*)yas_malloc(alloc);
+    while (1) {
+        if (size == alloc) {
+            alloc *= 2;
+            buffer = (char*)yas_realloc(buffer, alloc);
+        }
+        ssize_t n = read(fd, buffer + size, alloc - size);
+        if (n > 0) {
+            size += n;
+        } else if (n == 0) {
+            break;
+        } else {
+            yas_free(buffer);
+            return 0;
+        }
+    }
+    *sz = size;
+    return buffer;
+}
+
+static script_t* script_new(const char *data, size_t sz) {
+    script_t *script = (script_t*)yas_malloc(sizeof(script_t));
+    script->data = data;
+    script->size = sz;
+    script->position = 0;
+    script->line = 0;
+    script->mapped = 0;
+    script->owned = 0;
+    return script;
+}
+
+/*!
+    \brief Open a script file
+    \param filename path of the script
+    \return a new script_t, 0 if the file could not be read
+*/
+script_t* script_open(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return 0;
+    script_t *script = 0;
+    struct stat st;
+    if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *d = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (d != MAP_FAILED) {
+            madvise(d, st.st_size, MADV_SEQUENTIAL);
+            script = script_new((const char*)d, st.st_size);
+            script->mapped = 1;
+        }
+    }
+    if (!script) {
+        size_t sz = 0;
+        char *d = script_read_all(fd, &sz);
+        if (d) {
+            script = script_new(d, sz);
+            script->owned = 1;
+        }
+    }
+    close(fd);
+    return script;
+}
+
+/*!
+    \brief Create a script from a string
+    \param str Script content
+    \param sz Size of script content
+    \note \a str is not copied and must outlive the script_t
+*/
+script_t* script_from_string(const char *str, size_t sz) {
+    return script_new(str, sz);
+}
+
+/*!
+    \brief Close a script_t
+*/
+void script_close(script_t *script) {
+    if (!script)
+        return;
+    if (script->mapped)
+        munmap((void*)script->data, script->size);
+    else if (script->owned)
+        yas_free((void*)script->data);
+    yas_free(script);
+}
+
+/*!
+    \brief Get the next line of a script
+    \param script Script to read from
+    \param line Set to the start of the line, which is *not* zero-terminated
+    \param sz Set to the size of the line, excluding the line terminator
+    \return 0 when the end of the script has been reached, 1 otherwise
+*/
+int script_next_line(script_t *script, const char **line, size_t *sz) {
+    if (!script || script->position >= script->size)
+        return 0;
+    const char *start = script->data + script->position;
+    size_t left = script->size - script->position;
+    const char *end = (const char*)memchr(start, '\n', left);
+    size_t n = end ? (size_t)(end - start) : left;
+    script->position += end ? n + 1 : n;
+    ++script->line;
+    *line = start;
+    *sz = n;
+    return 1;
+}
+
+/*!
+    \return the number of the last line returned by script_next_line, starting at 1
+*/
+size_t script_line_number(script_t *script) {
+    return script ? script->line : 0;
+}
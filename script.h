@@ -0,0 +1,38 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _SCRIPT_H_
+#define _SCRIPT_H_
+
+/*!
+    \file script.h
+    \brief Definition of script_t
+*/
+
+#include <stddef.h>
+
+/*!
+    \brief Source of command lines for non-interactive execution
+    The content of a script is kept in a single buffer (memory-mapped when
+    possible) and command lines are handed out in place, without copies.
+*/
+typedef struct _script script_t;
+
+script_t* script_open(const char *filename);
+script_t* script_from_string(const char *str, size_t sz);
+void script_close(script_t *script);
+
+int script_next_line(script_t *script, const char **line, size_t *sz);
+size_t script_line_number(script_t *script);
+
+#endif /* _SCRIPT_H_ */
@@ -22,12 +22,24 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/wait.h>
 #include <sys/time.h>
 
 struct _task {
     pid_t pid;
     argv_t *argv;
+    /* "name=value" assignments preceding a queued command, 0 if none */
+    argv_t *assign;
+    char *in;
+    char *out;
+    int in_data;
+    /* descriptors of the process substitutions of a queued command */
+    int *fds;
+    size_t nfds;
+    /* command line holding the list or pipeline of a queued task, and its block */
+    command_t *command;
+    size_t block;
     int status;
     int status_code;
     struct timeval start;
@@ -38,7 +50,8 @@ enum task_status {
     TASK_STATUS_RUNNING,
     TASK_STATUS_EXITED,
     TASK_STATUS_SIGNALED,
-    TASK_STATUS_ERROR
+    TASK_STATUS_ERROR,
+    TASK_STATUS_QUEUED
 };
 
 /*!
@@ -48,6 +61,14 @@ task_t* task_new() {
     task_t *task = (task_t*)yas_malloc(sizeof(task_t));
     task->pid = 0;
     task->argv = 0;
+    task->assign = 0;
+    task->in = 0;
+    task->out = 0;
+    task->in_data = 0;
+    task->fds = 0;
+    task->nfds = 0;
+    task->command = 0;
+    task->block = 0;
     task->status = TASK_STATUS_UNKNOWN;
     task->status_code = 0;
     gettimeofday(&task->start, NULL);
@@ -61,6 +82,11 @@ void task_destroy(task_t *task) {
     if (!task)
         return;
     argv_destroy(task->argv);
+    argv_destroy(task->assign);
+    yas_free(task->in);
+    yas_free(task->out);
+    task_set_fds(task, 0, 0);
+    command_destroy(task->command);
     yas_free(task);
 }
 
@@ -94,6 +120,124 @@ void task_set_argv(task_t *task, argv_t *argv) {
         task->argv = argv;
 }
 
+/*!
+    \return the assignments preceding a queued task_t, if any
+*/
+argv_t* task_get_assign(task_t *task) {
+    return task ? task->assign : 0;
+}
+
+/*!
+    \brief Set the assignments preceding a task_t that is yet to be started
+    \note The task takes ownership of the argv_t
+*/
+void task_set_assign(task_t *task, argv_t *assign) {
+    if (!task)
+        return;
+    argv_destroy(task->assign);
+    task->assign = assign;
+}
+
+/*!
+    \return the input redirection of a queued task_t, if any
+*/
+const char* task_get_redir_in(task_t *task) {
+    return task ? task->in : 0;
+}
+
+/*!
+    \return the output redirection of a queued task_t, if any
+*/
+const char* task_get_redir_out(task_t *task) {
+    return task ? task->out : 0;
+}
+
+/*!
+    \return whether the input redirection of a queued task_t is the content of
+    a here-document instead of a file name
+*/
+int task_redir_in_is_data(task_t *task) {
+    return task ? task->in_data : 0;
+}
+
+/*!
+    \brief Set the redirections of a task_t that is yet to be started
+    \note The task takes ownership of the yas_malloc'ed strings
+*/
+void task_set_redir(task_t *task, char *in, int in_data, char *out) {
+    if (!task)
+        return;
+    yas_free(task->in);
+    yas_free(task->out);
+    task->in = in;
+    task->in_data = in_data;
+    task->out = out;
+}
+
+/*!
+    \return the process substitution descriptors of a queued task_t
+    \param n Set to the number of descriptors
+*/
+int* task_get_fds(task_t *task, size_t *n) {
+    *n = task ? task->nfds : 0;
+    return task ? task->fds : 0;
+}
+
+/*!
+    \brief Set the process substitution descriptors of a task_t that is yet to
+    be started, closing the previous ones
+    \note The task takes ownership of the yas_malloc'ed array and of the
+    descriptors
+*/
+void task_set_fds(task_t *task, int *fds, size_t n) {
+    if (!task)
+        return;
+    size_t i;
+    for (i = 0; i < task->nfds; ++i)
+        close(task->fds[i]);
+    yas_free(task->fds);
+    task->fds = fds;
+    task->nfds = n;
+}
+
+/*!
+    \return the command line holding the list or pipeline run by a queued
+    task_t, 0 if the task is an evaluated command
+    \param block Set to the index of the block of the list or pipeline
+*/
+command_t* task_get_block(task_t *task, size_t *block) {
+    *block = task ? task->block : 0;
+    return task ? task->command : 0;
+}
+
+/*!
+    \brief Set the list or pipeline run by a task_t that is yet to be started
+    \param command Command line whose program holds the block, referenced by
+    the task until it is destroyed
+    \param block Index of the block in the program
+*/
+void task_set_block(task_t *task, command_t *command, size_t block) {
+    if (!task)
+        return;
+    command_destroy(task->command);
+    task->command = command_ref(command);
+    task->block = block;
+}
+
+/*!
+    \return whether a task_t waits in the queue of its list
+*/
+int task_is_queued(task_t *task) {
+    return task ? task->status == TASK_STATUS_QUEUED : 0;
+}
+
+/*!
+    \return whether a task_t has been started and is not known to have finished
+*/
+int task_is_running(task_t *task) {
+    return task ? task->status == TASK_STATUS_UNKNOWN || task->status == TASK_STATUS_RUNNING : 0;
+}
+
 /*!
     \return the elapsed time, in seconds, from the start of a task_t
 */
@@ -157,13 +301,18 @@ void task_inspect(task_t *task) {
         }
     }
     
-    fprintf(stdout, "%u :  ", task->pid);
+    if (task->status == TASK_STATUS_QUEUED)
+        fprintf(stdout, "- :  ");
+    else
+        fprintf(stdout, "%u :  ", task->pid);
     if (task->status == TASK_STATUS_EXITED)
         fprintf(stdout, "exit %3u", task->status_code);
     else if (task->status == TASK_STATUS_SIGNALED)
         fprintf(stdout, "sig  %3u", task->status_code);
     else if (task->status == TASK_STATUS_ERROR)
         fprintf(stdout, "error   ");
+    else if (task->status == TASK_STATUS_QUEUED)
+        fprintf(stdout, "queued  ");
     else
         fprintf(stdout, "running ");
     fprintf(stdout, "    ");
@@ -178,9 +327,19 @@ void task_inspect(task_t *task) {
 /******************************************************************************/
 
 struct _task_list {
+    /* started tasks */
     size_t n;
     size_t a;
     task_t **d;
+    /* queued tasks, in FIFO order, from q[qhead] to q[qhead + qn - 1] */
+    size_t qhead;
+    size_t qn;
+    size_t qa;
+    task_t **q;
+    /* admission control counters */
+    unsigned long long queued_total;
+    long long wait_total;
+    long long wait_max;
 };
 
 static void task_list_grow(task_list_t *list, size_t n) {
@@ -198,6 +357,13 @@ task_list_t* task_list_new() {
     list->n = 0;
     list->a = 0;
     list->d = 0;
+    list->qhead = 0;
+    list->qn = 0;
+    list->qa = 0;
+    list->q = 0;
+    list->queued_total = 0;
+    list->wait_total = 0;
+    list->wait_max = 0;
     return list;
 }
 
@@ -210,7 +376,10 @@ void task_list_destroy(task_list_t *list) {
     size_t i;
     for (i = 0; i < list->n; ++i)
         task_destroy(list->d[i]);
+    for (i = 0; i < list->qn; ++i)
+        task_destroy(list->q[list->qhead + i]);
     yas_free(list->d);
+    yas_free(list->q);
     yas_free(list);
 }
 
@@ -218,18 +387,21 @@ void task_list_destroy(task_list_t *list) {
     \return the size of a task_list_t
 */
 size_t task_list_get_size(task_list_t *list) {
-    return list ? list->n : 0;
+    return list ? list->n + list->qn : 0;
 }
 
 /*!
     \return the tasks of a task_list_t
+    Started tasks come first, then queued tasks in FIFO order.
 */
 task_t* task_list_get_task(task_list_t *list, size_t index) {
-    return list ? list->d[index] : 0;
+    if (!list)
+        return 0;
+    return index < list->n ? list->d[index] : list->q[list->qhead + index - list->n];
 }
 
 /*!
-    \brief Add a task_t to a task_list_t
+    \brief Add a started task_t to a task_list_t
 */
 void task_list_add(task_list_t *list, task_t *task) {
     if (!list || !task)
@@ -243,11 +415,124 @@ void task_list_add(task_list_t *list, task_t *task) {
     \note The task is *not* destroyed
 */
 void task_list_remove(task_list_t *list, size_t index) {
-    if (!list || index >= list->n)
+    if (!list || index >= list->n + list->qn)
+        return;
+    if (index < list->n) {
+        --list->n;
+        if (index < list->n)
+            memmove(list->d + index,
+                    list->d + index + 1,
+                    (list->n - index) * sizeof(task_t*));
+        return;
+    }
+    index -= list->n;
+    --list->qn;
+    if (!index)
+        ++list->qhead;
+    else
+        memmove(list->q + list->qhead + index,
+                list->q + list->qhead + index + 1,
+                (list->qn - index) * sizeof(task_t*));
+}
+
+/*!
+    \brief Add a task_t that is yet to be started at the end of the queue of a task_list_t
+    Queued tasks are kept in the list, in FIFO order, to be started later with
+    task_list_start.
+*/
+void task_list_enqueue(task_list_t *list, task_t *task) {
+    if (!list || !task)
+        return;
+    task->status = TASK_STATUS_QUEUED;
+    gettimeofday(&task->start, NULL);
+    if (list->qhead + list->qn == list->qa) {
+        if (list->qhead && list->qhead >= list->qn) {
+            /* reuse the room left by started tasks */
+            memmove(list->q, list->q + list->qhead, list->qn * sizeof(task_t*));
+        } else {
+            list->qa = list->qa ? 2 * list->qa : 16;
+            list->q = (task_t**)yas_realloc(list->q, list->qa * sizeof(task_t*));
+            memmove(list->q, list->q + list->qhead, list->qn * sizeof(task_t*));
+        }
+        list->qhead = 0;
+    }
+    list->q[list->qhead + list->qn++] = task;
+    ++list->queued_total;
+}
+
+/*!
+    \return the oldest queued task of a task_list_t, 0 if none
+    \param index If non null, set to the index of the task in the list
+*/
+task_t* task_list_next_queued(task_list_t *list, size_t *index) {
+    if (!list || !list->qn)
+        return 0;
+    if (index)
+        *index = list->n;
+    return list->q[list->qhead];
+}
+
+/*!
+    \brief Start the oldest queued task_t of a task_list_t
+    \param list List the task belongs to
+    \param task Task returned by task_list_next_queued
+    \param pid PID of the process running the task
+    The time spent in the queue is accounted for and the elapsed time of the
+    task is counted from now on. The task moves to the end of the started
+    tasks, i.e. keeps its index.
+*/
+void task_list_start(task_list_t *list, task_t *task, pid_t pid) {
+    if (!task)
         return;
-    --list->n;
-    if (index < list->n)
-        memcpy(list->d + index,
-               list->d + index + 1,
-               (list->n - index) * sizeof(task_t*));
+    long long wait = task_get_elapsed_micros(task);
+    if (list) {
+        list->wait_total += wait;
+        if (wait > list->wait_max)
+            list->wait_max = wait;
+        if (list->qn && list->q[list->qhead] == task) {
+            ++list->qhead;
+            --list->qn;
+            task_list_add(list, task);
+        }
+    }
+    task->pid = pid;
+    task->status = TASK_STATUS_UNKNOWN;
+    gettimeofday(&task->start, NULL);
+}
+
+/*!
+    \return the number of tasks of a task_list_t that are running, i.e.
+    started and not yet removed from the list
+*/
+size_t task_list_count_running(task_list_t *list) {
+    return list ? list->n : 0;
+}
+
+/*!
+    \return the number of tasks of a task_list_t that wait in the queue
+*/
+size_t task_list_count_queued(task_list_t *list) {
+    return list ? list->qn : 0;
+}
+
+/*!
+    \return the number of tasks that were ever queued in a task_list_t
+*/
+unsigned long long task_list_queued_total(task_list_t *list) {
+    return list ? list->queued_total : 0;
+}
+
+/*!
+    \return the total time, in microseconds, spent in the queue by the tasks
+    started so far
+*/
+long long task_list_wait_total(task_list_t *list) {
+    return list ? list->wait_total : 0;
+}
+
+/*!
+    \return the longest time, in microseconds, spent in the queue by a task
+*/
+long long task_list_wait_max(task_list_t *list) {
+    return list ? list->wait_max : 0;
 }
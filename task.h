@@ -38,6 +38,22 @@ void task_set_pid(task_t *task, pid_t pid);
 argv_t* task_get_argv(task_t *task);
 void task_set_argv(task_t *task, argv_t *argv);
 
+argv_t* task_get_assign(task_t *task);
+void task_set_assign(task_t *task, argv_t *assign);
+
+const char* task_get_redir_in(task_t *task);
+const char* task_get_redir_out(task_t *task);
+int task_redir_in_is_data(task_t *task);
+void task_set_redir(task_t *task, char *in, int in_data, char *out);
+int* task_get_fds(task_t *task, size_t *n);
+void task_set_fds(task_t *task, int *fds, size_t n);
+
+command_t* task_get_block(task_t *task, size_t *block);
+void task_set_block(task_t *task, command_t *command, size_t block);
+
+int task_is_queued(task_t *task);
+int task_is_running(task_t *task);
+
 long long task_get_elapsed_seconds(task_t *task);
 long long task_get_elapsed_millis(task_t *task);
 long long task_get_elapsed_micros(task_t *task);
@@ -58,4 +74,14 @@ task_t* task_list_get_task(task_list_t *list, size_t index);
 void task_list_add(task_list_t *list, task_t *task);
 void task_list_remove(task_list_t *list, size_t index);
 
+void task_list_enqueue(task_list_t *list, task_t *task);
+task_t* task_list_next_queued(task_list_t *list, size_t *index);
+void task_list_start(task_list_t *list, task_t *task, pid_t pid);
+
+size_t task_list_count_running(task_list_t *list);
+size_t task_list_count_queued(task_list_t *list);
+unsigned long long task_list_queued_total(task_list_t *list);
+long long task_list_wait_total(task_list_t *list);
+long long task_list_wait_max(task_list_t *list);
+
 #endif /* _TASK_H_ */
@@ -36,11 +36,24 @@
     \return The number of available CPU cores
 */
 int get_cpu_count() {
-    FILE *f = popen("cat /proc/cpuinfo | grep processor | wc -l", "r");
-    char buffer[16];
-    size_t size = fread(buffer, 1, 16, f);
-    pclose(f);
-    return size ? atoi(buffer) : 0;
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/*!
+    \brief Check for trivial command lines
+    trivial = empty line, line made of whitspaces, comments
+*/
+int is_nontrivial(const char *s, size_t sz) {
+    if (!s)
+        return 0;
+    const char *end = s + sz;
+    while (s < end) {
+        if (!isspace(*s))
+            return *s != '#';
+        ++s;
+    }
+    return 0;
 }
 
 /*!
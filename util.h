@@ -19,7 +19,10 @@
     \brief Definition of several utility functions
 */
 
+#include <stddef.h>
+
 int get_cpu_count();
+int is_nontrivial(const char *s, size_t sz);
 
 char* get_pwd();
 char* get_username();
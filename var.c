@@ -0,0 +1,407 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#include "var.h"
+
+/*!
+    \file var.c
+    \brief Implementation of the shell variable store
+
+    Variables live in an open-addressing hash table with linear probing,
+    filled from the environment of the shell on first use. Each variable is
+    stored as a single "name=value" string, so that the environment passed
+    to commands is an array of pointers to the entries of exported
+    variables. That array is only rebuilt when an exported variable changed
+    since it was last built, which a generation counter keeps track of.
+    The environment of the shell process itself (environ) is left alone.
+*/
+
+#include "memory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern char **environ;
+
+/*!
+    \internal
+    \brief Slot of the hash table
+*/
+typedef struct {
+    unsigned long long hash;
+    char *entry;    /*!< "name=value", "name" if there is no value yet, 0 if free */
+    size_t length;  /*!< length of the name */
+    int flags;
+} var_slot_t;
+
+/* entry of the slots of unset variables, which must not stop probing */
+static char _var_removed[] = "";
+
+static var_slot_t *_var_slots = 0;
+static size_t _var_capacity = 0;
+/* live and removed slots */
+static size_t _var_used = 0;
+static size_t _var_size = 0;
+static int _var_loaded = 0;
+
+/* incremented whenever an exported variable changes */
+static unsigned long long _var_generation = 1;
+static char **_var_envp = 0;
+static size_t _var_aenvp = 0;
+static unsigned long long _var_envp_generation = 0;
+
+/*!
+    \internal
+    \brief FNV-1a hash of a variable name
+*/
+static unsigned long long var_hash(const char *name, size_t n) {
+    unsigned long long h = 14695981039346656037ULL;
+    size_t i;
+    for (i = 0; i < n; ++i) {
+        h ^= (unsigned char)name[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/*!
+    \internal
+    \brief Find the slot of a variable
+    \return the slot, 0 if there is no such variable
+*/
+static var_slot_t* var_find(const char *name, size_t n, unsigned long long h) {
+    if (!_var_capacity)
+        return 0;
+    size_t mask = _var_capacity - 1;
+    size_t i = h & mask;
+    while (_var_slots[i].entry) {
+        var_slot_t *s = _var_slots + i;
+        if (s->entry != _var_removed && s->hash == h && s->length == n
+                && !memcmp(s->entry, name, n))
+            return s;
+        i = (i + 1) & mask;
+    }
+    return 0;
+}
+
+/*!
+    \internal
+    \brief Make sure the hash table has room for one more variable
+    Removed slots are dropped when the table is rehashed.
+*/
+static void var_reserve() {
+    if (2 * (_var_used + 1) <= _var_capacity)
+        return;
+    size_t n = _var_capacity ? _var_capacity : 64;
+    while (4 * (_var_size + 1) > n)
+        n *= 2;
+    var_slot_t *slots = (var_slot_t*)yas_malloc(n * sizeof(var_slot_t));
+    memset(slots, 0, n * sizeof(var_slot_t));
+    size_t i;
+    for (i = 0; i < _var_capacity; ++i) {
+        var_slot_t *s = _var_slots + i;
+        if (!s->entry || s->entry == _var_removed)
+            continue;
+        size_t j = s->hash & (n - 1);
+        while (slots[j].entry)
+            j = (j + 1) & (n - 1);
+        slots[j] = *s;
+    }
+    yas_free(_var_slots);
+    _var_slots = slots;
+    _var_capacity = n;
+    _var_used = _var_size;
+}
+
+/*!
+    \internal
+    \brief Add a slot for a variable that is not in the table yet
+*/
+static var_slot_t* var_insert(const char *name, size_t n, unsigned long long h) {
+    var_reserve();
+    size_t mask = _var_capacity - 1;
+    size_t i = h & mask;
+    while (_var_slots[i].entry && _var_slots[i].entry != _var_removed)
+        i = (i + 1) & mask;
+    var_slot_t *s = _var_slots + i;
+    if (!s->entry)
+        ++_var_used;
+    ++_var_size;
+    s->hash = h;
+    s->length = n;
+    s->flags = 0;
+    s->entry = (char*)yas_malloc(n + 1);
+    memcpy(s->entry, name, n);
+    s->entry[n] = 0;
+    return s;
+}
+
+/*!
+    \internal
+    \brief Fill the table from the environment of the shell
+*/
+static void var_load() {
+    _var_loaded = 1;
+    char **e;
+    for (e = environ; e && *e; ++e) {
+        const char *eq = strchr(*e, '=');
+        if (!eq || eq == *e)
+            continue;
+        size_t n = eq - *e;
+        unsigned long long h = var_hash(*e, n);
+        /* the first definition wins, as with getenv */
+        if (var_find(*e, n, h))
+            continue;
+        var_slot_t *s = var_insert(*e, n, h);
+        yas_free(s->entry);
+        s->entry = (char*)yas_malloc(strlen(*e) + 1);
+        strcpy(s->entry, *e);
+        s->flags = VAR_EXPORT;
+    }
+}
+
+/*!
+    \internal
+    \brief Update a variable
+    \param value new value, 0 to only add flags
+*/
+static int var_store(const char *name, size_t n, const char *value, int flags) {
+    if (!_var_loaded)
+        var_load();
+    unsigned long long h = var_hash(name, n);
+    var_slot_t *s = var_find(name, n, h);
+    if (s && value && (s->flags & VAR_READONLY)) {
+        fprintf(stderr, "Readonly variable: %.*s\n", (int)n, name);
+        return -1;
+    }
+    if (!s)
+        s = var_insert(name, n, h);
+    if (value) {
+        size_t vn = strlen(value);
+        char *entry = (char*)yas_malloc(n + vn + 2);
+        memcpy(entry, name, n);
+        entry[n] = '=';
+        memcpy(entry + n + 1, value, vn + 1);
+        yas_free(s->entry);
+        s->entry = entry;
+    }
+    int changed = value || (flags & ~s->flags);
+    s->flags |= flags;
+    if (changed && (s->flags & VAR_EXPORT))
+        ++_var_generation;
+    return 0;
+}
+
+/*!
+    \return the length of the longest prefix of \a s that is a valid variable
+    name : a letter or underscore followed by letters, digits or underscores
+*/
+size_t var_name_length(const char *s) {
+    size_t n = 0;
+    if (!s || !(s[0] == '_' || (s[0] >= 'a' && s[0] <= 'z') || (s[0] >= 'A' && s[0] <= 'Z')))
+        return 0;
+    while (s[n] == '_' || (s[n] >= 'a' && s[n] <= 'z') || (s[n] >= 'A' && s[n] <= 'Z')
+            || (s[n] >= '0' && s[n] <= '9'))
+        ++n;
+    return n;
+}
+
+/*!
+    \return the value of a variable, 0 if it is not set
+*/
+const char* var_get(const char *name) {
+    if (!_var_loaded)
+        var_load();
+    if (!name)
+        return 0;
+    size_t n = strlen(name);
+    var_slot_t *s = var_find(name, n, var_hash(name, n));
+    return s && s->entry[n] == '=' ? s->entry + n + 1 : 0;
+}
+
+/*!
+    \return the attributes of a variable, 0 if it does not exist
+*/
+int var_flags(const char *name) {
+    if (!_var_loaded)
+        var_load();
+    if (!name)
+        return 0;
+    size_t n = strlen(name);
+    var_slot_t *s = var_find(name, n, var_hash(name, n));
+    return s ? s->flags : 0;
+}
+
+/*!
+    \brief Set a variable
+    \param name Name of the variable
+    \param value New value, 0 to keep the current one (e.g. for export)
+    \param flags Attributes to add to the variable
+    \return 0 on success, -1 if the name is invalid or the variable readonly
+*/
+int var_set(const char *name, const char *value, int flags) {
+    size_t n = var_name_length(name);
+    if (!n || name[n]) {
+        fprintf(stderr, "Invalid variable name: %s\n", name ? name : "");
+        return -1;
+    }
+    return var_store(name, n, value, flags);
+}
+
+/*!
+    \brief Set a variable from a "name=value" string
+    \return 0 on success, -1 if the assignment is invalid or the variable
+    readonly
+*/
+int var_assign(const char *assignment, int flags) {
+    size_t n = var_name_length(assignment);
+    if (!n || assignment[n] != '=') {
+        fprintf(stderr, "Invalid assignment: %s\n", assignment ? assignment : "");
+        return -1;
+    }
+    return var_store(assignment, n, assignment + n + 1, flags);
+}
+
+/*!
+    \brief Remove a variable
+    \return 0 on success (including when the variable did not exist), -1 if
+    the variable is readonly
+*/
+int var_unset(const char *name) {
+    if (!_var_loaded)
+        var_load();
+    if (!name)
+        return 0;
+    size_t n = strlen(name);
+    var_slot_t *s = var_find(name, n, var_hash(name, n));
+    if (!s)
+        return 0;
+    if (s->flags & VAR_READONLY) {
+        fprintf(stderr, "Readonly variable: %s\n", name);
+        return -1;
+    }
+    if (s->flags & VAR_EXPORT)
+        ++_var_generation;
+    yas_free(s->entry);
+    s->entry = _var_removed;
+    --_var_size;
+    return 0;
+}
+
+/*!
+    \internal
+    \return whether an exported slot is part of the environment of commands
+*/
+static int var_in_envp(const var_slot_t *s) {
+    return s->entry && s->entry != _var_removed && (s->flags & VAR_EXPORT)
+        && s->entry[s->length] == '=';
+}
+
+/*!
+    \brief Environment of commands : exported variables that have a value
+    \return a null-terminated array that remains valid until an exported
+    variable changes
+*/
+char** var_envp() {
+    if (!_var_loaded)
+        var_load();
+    if (_var_envp_generation == _var_generation)
+        return _var_envp;
+    if (_var_aenvp < _var_size + 1) {
+        _var_aenvp = _var_size + 1;
+        _var_envp = (char**)yas_realloc(_var_envp, _var_aenvp * sizeof(char*));
+    }
+    size_t i, k = 0;
+    for (i = 0; i < _var_capacity; ++i)
+        if (var_in_envp(_var_slots + i))
+            _var_envp[k++] = _var_slots[i].entry;
+    _var_envp[k] = 0;
+    _var_envp_generation = _var_generation;
+    return _var_envp;
+}
+
+/*!
+    \brief Environment of a command preceded by variable assignments
+    \param assignments "name=value" strings, which override exported variables
+    \param n number of assignments
+    \return a null-terminated array to release with yas_free, whose strings
+    remain valid until an exported variable changes or the assignments are
+    destroyed
+*/
+char** var_envp_with(char **assignments, size_t n) {
+    char **base = var_envp();
+    size_t i, j, k = 0, nbase = 0;
+    while (base[nbase])
+        ++nbase;
+    char **envp = (char**)yas_malloc((nbase + n + 1) * sizeof(char*));
+    for (i = 0; i < nbase; ++i) {
+        size_t len = strchr(base[i], '=') - base[i] + 1;
+        for (j = 0; j < n && strncmp(assignments[j], base[i], len); ++j)
+            ;
+        if (j == n)
+            envp[k++] = base[i];
+    }
+    for (j = 0; j < n; ++j) {
+        /* the last assignment of a variable wins */
+        size_t len = strchr(assignments[j], '=') - assignments[j] + 1;
+        for (i = j + 1; i < n && strncmp(assignments[i], assignments[j], len); ++i)
+            ;
+        if (i == n)
+            envp[k++] = assignments[j];
+    }
+    envp[k] = 0;
+    return envp;
+}
+
+static int var_compare(const void *a, const void *b) {
+    return strcmp((*(const var_slot_t**)a)->entry, (*(const var_slot_t**)b)->entry);
+}
+
+/*!
+    \brief Print the variables that have all the given attributes, sorted by name
+    The output can be read back by the shell : each line is prefixed by
+    "readonly" or "export" according to \a flags.
+*/
+void var_inspect(int flags) {
+    if (!_var_loaded)
+        var_load();
+    var_slot_t **sorted = (var_slot_t**)yas_malloc((_var_size + 1) * sizeof(var_slot_t*));
+    size_t i, k = 0;
+    for (i = 0; i < _var_capacity; ++i) {
+        var_slot_t *s = _var_slots + i;
+        if (s->entry && s->entry != _var_removed && (s->flags & flags) == flags)
+            sorted[k++] = s;
+    }
+    qsort(sorted, k, sizeof(var_slot_t*), var_compare);
+    for (i = 0; i < k; ++i) {
+        var_slot_t *s = sorted[i];
+        if (flags & VAR_READONLY)
+            fputs("readonly ", stdout);
+        else if (flags & VAR_EXPORT)
+            fputs("export ", stdout);
+        fwrite(s->entry, 1, s->length, stdout);
+        if (s->entry[s->length] == '=') {
+            const char *v = s->entry + s->length + 1;
+            fputs("=\"", stdout);
+            for (; *v; ++v) {
+                if (*v == '"' || *v == '\\' || *v == '$' || *v == '`')
+                    fputc('\\', stdout);
+                fputc(*v, stdout);
+            }
+            fputc('"', stdout);
+        }
+        fputc('\n', stdout);
+    }
+    yas_free(sorted);
+}
@@ -0,0 +1,45 @@
+/*******************************************************************************
+** YetAnotherShell
+** Copyright (c) 2010 Hugues Bruant & Nicolas Paglieri. All rights reserved
+** 
+** This file may be used under the terms of the GNU General Public License
+** version 3 as published by the Free Software Foundation.
+** See <http://www.gnu.org/licenses/> or GPL.txt included in the packaging of
+** this file.
+**
+** This file is provided AS IS with NO WARRANTY OF ANY KIND, INCLUDING THE
+** WARRANTY OF DESIGN, MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.
+*******************************************************************************/
+
+#ifndef _VAR_H_
+#define _VAR_H_
+
+/*!
+    \file var.h
+    \brief Definition of the shell variable store
+*/
+
+#include <stddef.h>
+
+/*!
+    \brief Attributes of a shell variable
+*/
+enum var_flags {
+    VAR_EXPORT = 1,     /*!< passed in the environment of commands */
+    VAR_READONLY = 2    /*!< cannot be assigned nor unset */
+};
+
+const char* var_get(const char *name);
+int var_flags(const char *name);
+int var_set(const char *name, const char *value, int flags);
+int var_assign(const char *assignment, int flags);
+int var_unset(const char *name);
+
+size_t var_name_length(const char *s);
+
+char** var_envp();
+char** var_envp_with(char **assignments, size_t n);
+
+void var_inspect(int flags);
+
+#endif /* _VAR_H_ */
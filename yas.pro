@@ -5,11 +5,12 @@ TARGET = yas
 CONFIG -= qt
 CONFIG += readline
 QMAKE_CFLAGS += -std=c99
+LIBS += -lpthread
 
 readline {
     DEFINES += YAS_USE_READLINE
     LIBS += -lreadline -lncurses
 }
 
-HEADERS += memory.h dstring.h input.h command.h argv.h task.h exec.h
-SOURCES += memory.c dstring.c input.c command.c argv.c task.c exec.c main.c
+HEADERS += memory.h arena.h dstring.h input.h command.h program.h options.h var.h arith.h cache.h path.h builtin.h argv.h task.h exec.h script.h check.h util.h
+SOURCES += memory.c arena.c dstring.c input.c command.c program.c options.c var.c arith.c cache.c path.c builtin.c argv.c task.c exec.c script.c check.c util.c main.c